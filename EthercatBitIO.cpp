@@ -0,0 +1,283 @@
+#include "EthercatBitIO.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// ##################################################################################
+// Local helpers:
+
+// Read nbits (at most 32) starting at bit shift of p. Only the bytes that hold the bits are touched.
+static inline uint32_t _loadBits(const uint8_t *p, uint32_t shift, uint32_t nbits)
+{
+    uint32_t nbytes = (shift + nbits + 7) / 8;
+    uint64_t v = 0;
+
+    for(uint32_t i = 0; i < nbytes; i++)
+    {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+
+    return (uint32_t)(v >> shift);
+}
+
+// Write nbits (at most 32) of value starting at bit shift of p, preserve all other bits.
+static inline void _storeBits(uint8_t *p, uint32_t shift, uint32_t value, uint32_t nbits)
+{
+    uint32_t nbytes = (shift + nbits + 7) / 8;
+    uint64_t mask = (((uint64_t)1 << nbits) - 1) << shift;
+    uint64_t v = 0;
+
+    for(uint32_t i = 0; i < nbytes; i++)
+    {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+
+    v = (v & ~mask) | (((uint64_t)value << shift) & mask);
+
+    for(uint32_t i = 0; i < nbytes; i++)
+    {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+#if defined(__AVX2__)
+// Expand 32 bits into 32 bytes of 0/1.
+static inline void _expand32(uint32_t bits, uint8_t *dst)
+{
+    // Byte i of the result selects source byte i/8. Shuffle works per 128 bit lane, both lanes hold the broadcast.
+    const __m256i shuffle = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                             2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i select = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+    __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32((int)bits), shuffle);
+    v = _mm256_cmpeq_epi8(_mm256_and_si256(v, select), select);
+    v = _mm256_and_si256(v, _mm256_set1_epi8(1));
+    _mm256_storeu_si256((__m256i*)dst, v);
+}
+#elif defined(__SSE2__)
+// Expand 16 bits into 16 bytes of 0/1.
+static inline void _expand16(uint32_t bits, uint8_t *dst)
+{
+    const __m128i select = _mm_set1_epi64x((long long)0x8040201008040201ULL);
+    // Replicate byte 0 into bytes 0..7 and byte 1 into bytes 8..15.
+    __m128i v = _mm_cvtsi32_si128((int)bits);
+    v = _mm_unpacklo_epi8(v, v);
+    v = _mm_unpacklo_epi16(v, v);
+    v = _mm_unpacklo_epi32(v, v);
+    v = _mm_cmpeq_epi8(_mm_and_si128(v, select), select);
+    v = _mm_and_si128(v, _mm_set1_epi8(1));
+    _mm_storeu_si128((__m128i*)dst, v);
+}
+#endif
+
+// ##################################################################################
+// Bulk bit conversion helpers:
+
+void ecUnpackBits(const uint8_t *src, uint32_t bit_offset, uint32_t count, uint8_t *dst)
+{
+    src += bit_offset / 8;
+    bit_offset %= 8;
+
+    uint32_t i = 0;
+
+#if defined(__AVX2__)
+    for(; i + 32 <= count; i += 32)
+    {
+        _expand32(_loadBits(src + i / 8, bit_offset, 32), dst + i);
+    }
+#elif defined(__SSE2__)
+    for(; i + 16 <= count; i += 16)
+    {
+        _expand16(_loadBits(src + i / 8, bit_offset, 16), dst + i);
+    }
+#endif
+
+    for(; i < count; i++)
+    {
+        uint32_t bit = bit_offset + i;
+        dst[i] = (src[bit >> 3] >> (bit & 7)) & 0x01;
+    }
+}
+
+void ecPackBits(const uint8_t *src, uint32_t count, uint8_t *dst, uint32_t bit_offset)
+{
+    dst += bit_offset / 8;
+    bit_offset %= 8;
+
+    uint32_t i = 0;
+
+#if defined(__AVX2__)
+    for(; i + 32 <= count; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        uint32_t bits = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        _storeBits(dst + i / 8, bit_offset, bits, 32);
+    }
+#elif defined(__SSE2__)
+    for(; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        uint32_t bits = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) & 0xFFFF;
+        _storeBits(dst + i / 8, bit_offset, bits, 16);
+    }
+#endif
+
+    for(; i < count; i++)
+    {
+        uint32_t bit = bit_offset + i;
+        if(src[i])
+        {
+            dst[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+        }
+        else
+        {
+            dst[bit >> 3] &= (uint8_t)~(1 << (bit & 7));
+        }
+    }
+}
+
+// ##################################################################################
+// EthercatDigitalBank class:
+
+bool EthercatDigitalBank::addInputs(uint16_t slave_id)
+{
+    if( (slave_id < 1) || (slave_id > ec_slavecount) )
+    {
+        errorMessage = "EthercatDigitalBank error: slave id is out of range.";
+        return false;
+    }
+
+    if( (ec_slave[slave_id].Ibits == 0) || (ec_slave[slave_id].inputs == NULL) )
+    {
+        errorMessage = "EthercatDigitalBank error: slave has no mapped inputs.";
+        return false;
+    }
+
+    _inputSlaves.push_back({slave_id, _inputCount});
+    _addRun(_inputRuns, ec_slave[slave_id].inputs, ec_slave[slave_id].Istartbit, ec_slave[slave_id].Ibits, _inputCount);
+    _inputCount += ec_slave[slave_id].Ibits;
+    _inputs.resize(_inputCount, 0);
+
+    return true;
+}
+
+bool EthercatDigitalBank::addOutputs(uint16_t slave_id)
+{
+    if( (slave_id < 1) || (slave_id > ec_slavecount) )
+    {
+        errorMessage = "EthercatDigitalBank error: slave id is out of range.";
+        return false;
+    }
+
+    if( (ec_slave[slave_id].Obits == 0) || (ec_slave[slave_id].outputs == NULL) )
+    {
+        errorMessage = "EthercatDigitalBank error: slave has no mapped outputs.";
+        return false;
+    }
+
+    _outputSlaves.push_back({slave_id, _outputCount});
+    _addRun(_outputRuns, ec_slave[slave_id].outputs, ec_slave[slave_id].Ostartbit, ec_slave[slave_id].Obits, _outputCount);
+    _outputCount += ec_slave[slave_id].Obits;
+    _outputs.resize(_outputCount, 0);
+
+    return true;
+}
+
+int EthercatDigitalBank::addBitMappedSlaves(void)
+{
+    int added = 0;
+
+    for(int cnt = 1; cnt <= ec_slavecount; cnt++)
+    {
+        bool flag = false;
+
+        // ec_config_map() leaves Ibytes/Obytes at zero for slaves that occupy less than one byte.
+        if( (ec_slave[cnt].Ibits > 0) && (ec_slave[cnt].Ibits < 8) )
+        {
+            flag |= addInputs(cnt);
+        }
+        if( (ec_slave[cnt].Obits > 0) && (ec_slave[cnt].Obits < 8) )
+        {
+            flag |= addOutputs(cnt);
+        }
+        if(flag)
+        {
+            added++;
+        }
+    }
+
+    return added;
+}
+
+void EthercatDigitalBank::clear(void)
+{
+    _inputRuns.clear();
+    _outputRuns.clear();
+    _inputSlaves.clear();
+    _outputSlaves.clear();
+    _inputs.clear();
+    _outputs.clear();
+    _inputCount = 0;
+    _outputCount = 0;
+}
+
+void EthercatDigitalBank::refreshInputs(void)
+{
+    for(const _Run &run : _inputRuns)
+    {
+        ecUnpackBits(run.base, run.bitOffset, run.count, &_inputs[run.channel]);
+    }
+}
+
+void EthercatDigitalBank::flushOutputs(void)
+{
+    for(const _Run &run : _outputRuns)
+    {
+        ecPackBits(&_outputs[run.channel], run.count, run.base, run.bitOffset);
+    }
+}
+
+int EthercatDigitalBank::getInputChannel(uint16_t slave_id)
+{
+    for(const _SlaveChannel &item : _inputSlaves)
+    {
+        if(item.slave == slave_id)
+        {
+            return (int)item.channel;
+        }
+    }
+    return -1;
+}
+
+int EthercatDigitalBank::getOutputChannel(uint16_t slave_id)
+{
+    for(const _SlaveChannel &item : _outputSlaves)
+    {
+        if(item.slave == slave_id)
+        {
+            return (int)item.channel;
+        }
+    }
+    return -1;
+}
+
+void EthercatDigitalBank::_addRun(std::vector<_Run> &runs, uint8_t *base, uint32_t bit_offset, uint32_t count, uint32_t channel)
+{
+    base += bit_offset / 8;
+    bit_offset %= 8;
+
+    if(!runs.empty())
+    {
+        _Run &last = runs.back();
+        uint32_t end = last.bitOffset + last.count;
+
+        // Merge if the new bits continue the previous run in the IOmap and in channel numbering.
+        if( (last.base + end / 8 == base) && (end % 8 == bit_offset) && (last.channel + last.count == channel) )
+        {
+            last.count += count;
+            return;
+        }
+    }
+
+    runs.push_back({base, bit_offset, count, channel});
+}
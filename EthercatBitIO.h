@@ -0,0 +1,131 @@
+#ifndef _ETHERCATBITIO_H
+#define _ETHERCATBITIO_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <vector>
+#include "ethercat.h"
+
+// ##################################################################################
+// Bulk bit conversion helpers:
+
+/*
+When the IOmap is configured without byte alignment (ec_config_map), slaves with less than 8 bits of
+process data share bytes with their neighbours. The helpers below convert between that bit-packed image
+and one byte per channel (0 or 1) in bulk, 32 channels at a time with AVX2, 16 with SSE2 and a
+scalar loop otherwise. The implementation is selected at compile time (-mavx2 or -march=native for AVX2).
+*/
+
+/**
+ * @brief Unpack count bits starting at bit bit_offset of src into count bytes of dst (0 or 1 each).
+ * Bit 0 of a byte is the first channel, as in the EtherCAT process image.
+ */
+void ecUnpackBits(const uint8_t *src, uint32_t bit_offset, uint32_t count, uint8_t *dst);
+
+/**
+ * @brief Pack count bytes of src (zero = false, non zero = true) into dst starting at bit bit_offset.
+ * Bits of dst outside the written range are preserved, so neighbouring terminals are not touched.
+ */
+void ecPackBits(const uint8_t *src, uint32_t count, uint8_t *dst, uint32_t bit_offset);
+
+// ###################################################################################
+// EthercatDigitalBank class:
+
+/**
+ * @brief Flat view over the digital channels of several slaves.
+ * Channels of all added slaves are numbered consecutively in the order they were added.
+ * Adjacent channels in the IOmap are merged into runs, so one refresh is a few bulk conversions
+ * instead of one shift and mask per channel.
+ * @note Build the bank after SimpleEthercat::configMap(). The slave pointers into the IOmap are
+ * captured at that time and must be rebuilt after every new mapping.
+ */
+class EthercatDigitalBank
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    /**
+     * @brief Add all input bits of a slave to the bank.
+     * @return true if successed.
+     */
+    bool addInputs(uint16_t slave_id);
+
+    /**
+     * @brief Add all output bits of a slave to the bank.
+     * @return true if successed.
+     */
+    bool addOutputs(uint16_t slave_id);
+
+    /**
+     * @brief Add every slave that is mapped at bit granularity (less than one byte of inputs or outputs).
+     * @return Number of slaves added.
+     */
+    int addBitMappedSlaves(void);
+
+    // Remove all channels from the bank.
+    void clear(void);
+
+    // Copy all input channels from the IOmap into the input array. Call after updateProccess().
+    void refreshInputs(void);
+
+    // Copy the output array into the IOmap. Call before updateProccess().
+    void flushOutputs(void);
+
+    // Return the number of input channels.
+    uint32_t getInputCount(void) {return _inputCount;}
+
+    // Return the number of output channels.
+    uint32_t getOutputCount(void) {return _outputCount;}
+
+    // Return input channel array. One byte per channel with value 0 or 1.
+    const uint8_t* inputs(void) {return _inputs.data();}
+
+    // Return output channel array. One byte per channel, any non zero value sets the output.
+    uint8_t* outputs(void) {return _outputs.data();}
+
+    // Return the first input channel of a slave or -1 if slave is not in the bank.
+    int getInputChannel(uint16_t slave_id);
+
+    // Return the first output channel of a slave or -1 if slave is not in the bank.
+    int getOutputChannel(uint16_t slave_id);
+
+private:
+
+    // Contiguous range of bits in the IOmap.
+    struct _Run
+    {
+        uint8_t *base;
+        uint32_t bitOffset;
+        uint32_t count;
+        uint32_t channel;
+    };
+
+    // First channel of each slave added to the bank.
+    struct _SlaveChannel
+    {
+        uint16_t slave;
+        uint32_t channel;
+    };
+
+    std::vector<_Run> _inputRuns;
+    std::vector<_Run> _outputRuns;
+
+    std::vector<_SlaveChannel> _inputSlaves;
+    std::vector<_SlaveChannel> _outputSlaves;
+
+    std::vector<uint8_t> _inputs;
+    std::vector<uint8_t> _outputs;
+
+    uint32_t _inputCount = 0;
+    uint32_t _outputCount = 0;
+
+    // Append a bit range to the run list, merge with the previous run if it is adjacent.
+    static void _addRun(std::vector<_Run> &runs, uint8_t *base, uint32_t bit_offset, uint32_t count, uint32_t channel);
+};
+
+#endif
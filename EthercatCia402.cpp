@@ -0,0 +1,282 @@
+#include "EthercatCia402.h"
+#include <cstring>
+#include <algorithm>
+
+// ##################################################################################
+// Local helpers:
+
+// Process data is little endian, read and write it with memcpy to avoid unaligned access.
+template <typename T>
+static inline T _load(const uint8_t *p)
+{
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+template <typename T>
+static inline void _store(uint8_t *p, T value)
+{
+    memcpy(p, &value, sizeof(T));
+}
+
+// Return 0xFFFF for true and 0 for false. Masks keep the per axis loops free of branches.
+static inline uint16_t _mask(bool flag)
+{
+    return (uint16_t)-(uint16_t)flag;
+}
+
+// Return pointer into the process image or nullptr for an offset of -1.
+static inline uint8_t* _pointer(uint8_t *base, int offset)
+{
+    return (offset < 0) ? nullptr : base + offset;
+}
+
+// ##################################################################################
+// EthercatCia402 class:
+
+int EthercatCia402::addAxis(uint16_t slave_id, const EcCia402Pdo &pdo, EcCia402Mode mode)
+{
+    if( (slave_id < 1) || (slave_id > ec_slavecount) )
+    {
+        errorMessage = "EthercatCia402 error: slave id is out of range.";
+        return -1;
+    }
+
+    uint8_t *outputs = ec_slave[slave_id].outputs;
+    uint8_t *inputs = ec_slave[slave_id].inputs;
+
+    if( (outputs == NULL) || (inputs == NULL) || (pdo.controlword < 0) || (pdo.statusword < 0) )
+    {
+        errorMessage = "EthercatCia402 error: controlword and statusword must be mapped.";
+        return -1;
+    }
+
+    // Every object has to be inside the process data of the slave.
+    if( ((uint32_t)pdo.controlword + 2 > ec_slave[slave_id].Obytes) || ((uint32_t)pdo.statusword + 2 > ec_slave[slave_id].Ibytes) ||
+        ((pdo.modesOfOperation >= 0) && ((uint32_t)pdo.modesOfOperation + 1 > ec_slave[slave_id].Obytes)) ||
+        ((pdo.targetPosition >= 0) && ((uint32_t)pdo.targetPosition + 4 > ec_slave[slave_id].Obytes)) ||
+        ((pdo.targetVelocity >= 0) && ((uint32_t)pdo.targetVelocity + 4 > ec_slave[slave_id].Obytes)) ||
+        ((pdo.targetTorque >= 0) && ((uint32_t)pdo.targetTorque + 2 > ec_slave[slave_id].Obytes)) ||
+        ((pdo.positionActual >= 0) && ((uint32_t)pdo.positionActual + 4 > ec_slave[slave_id].Ibytes)) ||
+        ((pdo.velocityActual >= 0) && ((uint32_t)pdo.velocityActual + 4 > ec_slave[slave_id].Ibytes)) ||
+        ((pdo.torqueActual >= 0) && ((uint32_t)pdo.torqueActual + 2 > ec_slave[slave_id].Ibytes)) )
+    {
+        errorMessage = "EthercatCia402 error: PDO offset is outside the process data of the slave.";
+        return -1;
+    }
+
+    _slave.push_back(slave_id);
+    _pControlword.push_back(_pointer(outputs, pdo.controlword));
+    _pMode.push_back(_pointer(outputs, pdo.modesOfOperation));
+    _pTargetPosition.push_back(_pointer(outputs, pdo.targetPosition));
+    _pTargetVelocity.push_back(_pointer(outputs, pdo.targetVelocity));
+    _pTargetTorque.push_back(_pointer(outputs, pdo.targetTorque));
+    _pStatusword.push_back(_pointer(inputs, pdo.statusword));
+    _pPositionActual.push_back(_pointer(inputs, pdo.positionActual));
+    _pVelocityActual.push_back(_pointer(inputs, pdo.velocityActual));
+    _pTorqueActual.push_back(_pointer(inputs, pdo.torqueActual));
+
+    _statusword.push_back(0);
+    _controlword.push_back(0);
+    _state.push_back(CIA402_NOT_READY);
+    _request.push_back(_REQ_DISABLE);
+    _mode.push_back(mode);
+    _targetPosition.push_back(0);
+    _targetVelocity.push_back(0);
+    _targetTorque.push_back(0);
+    _positionActual.push_back(0);
+    _velocityActual.push_back(0);
+    _torqueActual.push_back(0);
+    _followPosition.push_back(pdo.positionActual >= 0 ? 1 : 0);
+
+    return (int)_slave.size() - 1;
+}
+
+bool EthercatCia402::configureModes(SimpleEthercat &ethercat)
+{
+    for(size_t i = 0; i < _slave.size(); i++)
+    {
+        if(_pMode[i] != nullptr)
+        {
+            continue;
+        }
+        if(ethercat.writeSDO(_slave[i], 0x6060, 0x00, _mode[i]) <= 0)
+        {
+            errorMessage = "EthercatCia402 error: Can not write modes of operation of slave " + std::to_string(_slave[i]) + ".";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void EthercatCia402::enable(int axis)
+{
+    _request[axis] = _REQ_ENABLE;
+}
+
+void EthercatCia402::disable(int axis)
+{
+    _request[axis] = _REQ_DISABLE;
+}
+
+void EthercatCia402::quickStop(int axis)
+{
+    _request[axis] = _REQ_QUICK_STOP;
+}
+
+void EthercatCia402::resetFault(int axis)
+{
+    _request[axis] = _REQ_FAULT_RESET;
+}
+
+void EthercatCia402::enableAll(void)
+{
+    std::fill(_request.begin(), _request.end(), (uint16_t)_REQ_ENABLE);
+}
+
+void EthercatCia402::disableAll(void)
+{
+    std::fill(_request.begin(), _request.end(), (uint16_t)_REQ_DISABLE);
+}
+
+void EthercatCia402::setMode(int axis, EcCia402Mode mode)
+{
+    _mode[axis] = mode;
+}
+
+bool EthercatCia402::isAllEnabled(void)
+{
+    uint16_t all = 1;
+
+    for(size_t i = 0; i < _state.size(); i++)
+    {
+        all &= (_state[i] == CIA402_OPERATION_ENABLED);
+    }
+
+    return all;
+}
+
+void EthercatCia402::update(void)
+{
+    const size_t n = _slave.size();
+
+    // Gather inputs of all axes.
+    for(size_t i = 0; i < n; i++)
+    {
+        _statusword[i] = _load<uint16_t>(_pStatusword[i]);
+        if(_pPositionActual[i] != nullptr) _positionActual[i] = _load<int32_t>(_pPositionActual[i]);
+        if(_pVelocityActual[i] != nullptr) _velocityActual[i] = _load<int32_t>(_pVelocityActual[i]);
+        if(_pTorqueActual[i] != nullptr) _torqueActual[i] = _load<int16_t>(_pTorqueActual[i]);
+    }
+
+    /*
+    Decode states and compute controlwords. The loop only uses selects on plain 16 bit arrays, so the 
+    compiler turns it into vector code and all axes are handled in a few instructions per lane.
+    Statusword patterns (CiA 402, 0x6041):
+        xxxx xxxx x0xx 0000  Not ready to switch on
+        xxxx xxxx x1xx 0000  Switch on disabled
+        xxxx xxxx x01x 0001  Ready to switch on
+        xxxx xxxx x01x 0011  Switched on
+        xxxx xxxx x01x 0111  Operation enabled
+        xxxx xxxx x00x 0111  Quick stop active
+        xxxx xxxx x0xx 1111  Fault reaction active
+        xxxx xxxx x0xx 1000  Fault
+    Controlword commands (0x6040): shutdown 0x06, switch on 0x07, enable operation 0x0F, 
+    quick stop 0x02, disable voltage 0x00, fault reset 0x80 (rising edge).
+    */
+    const uint16_t *__restrict sw = _statusword.data();
+    uint16_t *__restrict cw = _controlword.data();
+    uint16_t *__restrict state = _state.data();
+    uint16_t *__restrict request = _request.data();
+
+    for(size_t i = 0; i < n; i++)
+    {
+        uint16_t a = sw[i] & 0x004F;
+        uint16_t b = sw[i] & 0x006F;
+
+        // The patterns exclude each other, so the state is an OR of masked constants.
+        uint16_t st = (_mask(a == 0x0040) & CIA402_SWITCH_ON_DISABLED) |
+                      (_mask(b == 0x0021) & CIA402_READY_TO_SWITCH_ON) |
+                      (_mask(b == 0x0023) & CIA402_SWITCHED_ON) |
+                      (_mask(b == 0x0027) & CIA402_OPERATION_ENABLED) |
+                      (_mask(b == 0x0007) & CIA402_QUICK_STOP_ACTIVE) |
+                      (_mask(a == 0x000F) & CIA402_FAULT_REACTION_ACTIVE) |
+                      (_mask(a == 0x0008) & CIA402_FAULT);
+
+        uint16_t cwEnable = (_mask(st == CIA402_SWITCH_ON_DISABLED) & 0x06) |
+                            (_mask(st == CIA402_READY_TO_SWITCH_ON) & 0x07) |
+                            (_mask((st == CIA402_SWITCHED_ON) | (st == CIA402_OPERATION_ENABLED)) & 0x0F);
+        uint16_t cwDisable = _mask((st >= CIA402_SWITCH_ON_DISABLED) & (st <= CIA402_OPERATION_ENABLED)) & 0x06;
+        uint16_t quickStop = _mask((st == CIA402_OPERATION_ENABLED) | (st == CIA402_QUICK_STOP_ACTIVE));
+        uint16_t cwQuickStop = (quickStop & 0x02) | (~quickStop & cwDisable);
+        uint16_t fault = _mask(st == CIA402_FAULT);
+        uint16_t cwReset = (fault & ((cw[i] & 0x80) ^ 0x80)) | (~fault & cwDisable);
+
+        uint16_t req = request[i];
+        cw[i] = (_mask(req == _REQ_DISABLE) & cwDisable) |
+                (_mask(req == _REQ_ENABLE) & cwEnable) |
+                (_mask(req == _REQ_QUICK_STOP) & cwQuickStop) |
+                (_mask(req == _REQ_FAULT_RESET) & cwReset);
+
+        // A finished fault reset falls back to disabled (_REQ_DISABLE is zero).
+        request[i] = req & _mask((req != _REQ_FAULT_RESET) | (st >= CIA402_FAULT_REACTION_ACTIVE));
+
+        state[i] = st;
+    }
+
+    // Hold targets at the actual position / zero until the axis is enabled. Separate pass for 32 bit lanes.
+    const int32_t *__restrict follow = _followPosition.data();
+    const int32_t *__restrict pa = _positionActual.data();
+    int32_t *__restrict tp = _targetPosition.data();
+    int32_t *__restrict tv = _targetVelocity.data();
+    int16_t *__restrict tt = _targetTorque.data();
+
+    for(size_t i = 0; i < n; i++)
+    {
+        // Load every operand unconditionally, the selects then become vector blends.
+        int32_t enabled = -(int32_t)(state[i] == CIA402_OPERATION_ENABLED);
+        int32_t keep = enabled | (follow[i] - 1);
+        int32_t position = tp[i];
+        int32_t actual = pa[i];
+        tp[i] = (position & keep) | (actual & ~keep);
+        tv[i] = tv[i] & enabled;
+        tt[i] = tt[i] & (int16_t)enabled;
+    }
+
+    // Scatter outputs for the next cycle.
+    for(size_t i = 0; i < n; i++)
+    {
+        _store<uint16_t>(_pControlword[i], cw[i]);
+        if(_pMode[i] != nullptr) _store<int8_t>(_pMode[i], _mode[i]);
+        if(_pTargetPosition[i] != nullptr) _store<int32_t>(_pTargetPosition[i], tp[i]);
+        if(_pTargetVelocity[i] != nullptr) _store<int32_t>(_pTargetVelocity[i], tv[i]);
+        if(_pTargetTorque[i] != nullptr) _store<int16_t>(_pTargetTorque[i], tt[i]);
+    }
+}
+
+const char* EthercatCia402::stateToString(EcCia402State state)
+{
+    switch(state)
+    {
+        case CIA402_NOT_READY:
+            return "NOT_READY";
+        case CIA402_SWITCH_ON_DISABLED:
+            return "SWITCH_ON_DISABLED";
+        case CIA402_READY_TO_SWITCH_ON:
+            return "READY_TO_SWITCH_ON";
+        case CIA402_SWITCHED_ON:
+            return "SWITCHED_ON";
+        case CIA402_OPERATION_ENABLED:
+            return "OPERATION_ENABLED";
+        case CIA402_QUICK_STOP_ACTIVE:
+            return "QUICK_STOP_ACTIVE";
+        case CIA402_FAULT_REACTION_ACTIVE:
+            return "FAULT_REACTION_ACTIVE";
+        case CIA402_FAULT:
+            return "FAULT";
+    }
+
+    return "UNKNOWN";
+}
@@ -0,0 +1,194 @@
+#ifndef _ETHERCATCIA402_H
+#define _ETHERCATCIA402_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <vector>
+#include "SimpleEthercat.h"
+
+// ##################################################################################
+// Data structures:
+
+// CiA 402 power state machine states, decoded from statusword 0x6041.
+enum EcCia402State : uint8_t
+{
+    CIA402_NOT_READY = 0,
+    CIA402_SWITCH_ON_DISABLED,
+    CIA402_READY_TO_SWITCH_ON,
+    CIA402_SWITCHED_ON,
+    CIA402_OPERATION_ENABLED,
+    CIA402_QUICK_STOP_ACTIVE,
+    CIA402_FAULT_REACTION_ACTIVE,
+    CIA402_FAULT
+};
+
+// Cyclic synchronous modes of operation, object 0x6060.
+enum EcCia402Mode : int8_t
+{
+    CIA402_MODE_CSP = 8,
+    CIA402_MODE_CSV = 9,
+    CIA402_MODE_CST = 10
+};
+
+/**
+ * @brief Byte offsets of the CiA 402 objects in the process data of one drive.
+ * Output offsets are relative to ec_slave[slave].outputs, input offsets to ec_slave[slave].inputs.
+ * -1 means the object is not mapped. Only controlword and statusword are required.
+ */
+struct EcCia402Pdo
+{
+    // Outputs:
+    int controlword = -1;           // 0x6040 UNSIGNED16
+    int modesOfOperation = -1;      // 0x6060 INTEGER8
+    int targetPosition = -1;        // 0x607A INTEGER32
+    int targetVelocity = -1;        // 0x60FF INTEGER32
+    int targetTorque = -1;          // 0x6071 INTEGER16
+
+    // Inputs:
+    int statusword = -1;            // 0x6041 UNSIGNED16
+    int positionActual = -1;        // 0x6064 INTEGER32
+    int velocityActual = -1;        // 0x606C INTEGER32
+    int torqueActual = -1;          // 0x6077 INTEGER16
+};
+
+// ###################################################################################
+// EthercatCia402 class:
+
+/**
+ * @brief CiA 402 power state machine for a group of drives, working directly on the process image.
+ * All axes are kept in structure-of-arrays form. update() gathers the statuswords of every axis, decodes the
+ * states and computes the controlwords in branch free passes over the arrays, then scatters controlword,
+ * mode and targets back into the outputs.
+ * While an axis is not in OPERATION ENABLED its position target follows the actual position, so enabling
+ * a CSP axis never makes it jump.
+ * @note Add axes after SimpleEthercat::configMap(), call update() from the cyclic thread right after
+ * updateProccess(). The new outputs are sent with the next updateProccess().
+ */
+class EthercatCia402
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    /**
+     * @brief Add a drive.
+     * @return Axis number, or -1 if failed.
+     */
+    int addAxis(uint16_t slave_id, const EcCia402Pdo &pdo, EcCia402Mode mode = CIA402_MODE_CSP);
+
+    // Return number of axes.
+    int getAxisCount(void) {return (int)_slave.size();}
+
+    /**
+     * @brief Write modes of operation by SDO for axes that have no 0x6060 in their PDO mapping.
+     * Call in PRE_OP or SAFE_OP, before the cyclic loop starts.
+     * @return true if successed.
+     */
+    bool configureModes(SimpleEthercat &ethercat);
+
+    // Request OPERATION ENABLED for an axis. The state machine walks there over the next cycles.
+    void enable(int axis);
+
+    // Request READY TO SWITCH ON (power stage off) for an axis.
+    void disable(int axis);
+
+    // Request QUICK STOP for an axis.
+    void quickStop(int axis);
+
+    // Request reset of a fault. The axis stays disabled after the reset.
+    void resetFault(int axis);
+
+    void enableAll(void);
+
+    void disableAll(void);
+
+    // Set mode of operation of an axis. Takes effect with the next update().
+    void setMode(int axis, EcCia402Mode mode);
+
+    /**
+     * @brief Run the state machines of all axes. Call once per cycle after updateProccess().
+     */
+    void update(void);
+
+    EcCia402State getState(int axis) {return (EcCia402State)_state[axis];}
+
+    // Return true if axis is in OPERATION ENABLED.
+    bool isEnabled(int axis) {return _state[axis] == CIA402_OPERATION_ENABLED;}
+
+    // Return true if axis is in FAULT or FAULT REACTION ACTIVE.
+    bool isFault(int axis) {return _state[axis] >= CIA402_FAULT_REACTION_ACTIVE;}
+
+    // Return true if every axis is in OPERATION ENABLED.
+    bool isAllEnabled(void);
+
+    uint16_t getStatusword(int axis) {return _statusword[axis];}
+
+    void setTargetPosition(int axis, int32_t value) {_targetPosition[axis] = value;}
+
+    void setTargetVelocity(int axis, int32_t value) {_targetVelocity[axis] = value;}
+
+    void setTargetTorque(int axis, int16_t value) {_targetTorque[axis] = value;}
+
+    int32_t getPositionActual(int axis) {return _positionActual[axis];}
+
+    int32_t getVelocityActual(int axis) {return _velocityActual[axis];}
+
+    int16_t getTorqueActual(int axis) {return _torqueActual[axis];}
+
+    // Return target position array of all axes, for bulk writes from one loop.
+    int32_t* targetPositions(void) {return _targetPosition.data();}
+
+    int32_t* targetVelocities(void) {return _targetVelocity.data();}
+
+    int16_t* targetTorques(void) {return _targetTorque.data();}
+
+    const int32_t* positionActuals(void) {return _positionActual.data();}
+
+    // Return CiA 402 state as string.
+    static const char* stateToString(EcCia402State state);
+
+private:
+
+    // Requested power state of an axis.
+    enum _Request : uint16_t
+    {
+        _REQ_DISABLE = 0,
+        _REQ_ENABLE,
+        _REQ_QUICK_STOP,
+        _REQ_FAULT_RESET
+    };
+
+    // Binding of the axes to the process image. nullptr for objects that are not mapped.
+    std::vector<uint16_t> _slave;
+    std::vector<uint8_t*> _pControlword;
+    std::vector<uint8_t*> _pMode;
+    std::vector<uint8_t*> _pTargetPosition;
+    std::vector<uint8_t*> _pTargetVelocity;
+    std::vector<uint8_t*> _pTargetTorque;
+    std::vector<const uint8_t*> _pStatusword;
+    std::vector<const uint8_t*> _pPositionActual;
+    std::vector<const uint8_t*> _pVelocityActual;
+    std::vector<const uint8_t*> _pTorqueActual;
+
+    // Axis data, one element per axis.
+    std::vector<uint16_t> _statusword;
+    std::vector<uint16_t> _controlword;
+    std::vector<uint16_t> _state;
+    std::vector<uint16_t> _request;
+    std::vector<int8_t> _mode;
+    std::vector<int32_t> _targetPosition;
+    std::vector<int32_t> _targetVelocity;
+    std::vector<int16_t> _targetTorque;
+    std::vector<int32_t> _positionActual;
+    std::vector<int32_t> _velocityActual;
+    std::vector<int16_t> _torqueActual;
+
+    // 1 if the position target follows the actual position while the axis is not enabled.
+    std::vector<int32_t> _followPosition;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "EthercatEmergency.h"
+#include <chrono>
+
+// ##################################################################################
+// EthercatEmergency class:
+
+EthercatEmergency::EthercatEmergency(uint32_t size)
+{
+    uint64_t n = 2;
+    while(n < size)
+    {
+        n <<= 1;
+    }
+
+    _ring.reset(new EcEmergency[n]);
+    _mask = n - 1;
+}
+
+EthercatEmergency::~EthercatEmergency()
+{
+    stop();
+}
+
+int EthercatEmergency::subscribe(const Callback &callback, uint16_t slave)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _Subscriber subscriber;
+    subscriber.id = _nextId++;
+    subscriber.slave = slave;
+    subscriber.callback = callback;
+    _subscribers.push_back(subscriber);
+
+    return subscriber.id;
+}
+
+void EthercatEmergency::unsubscribe(int id)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for(size_t i = 0; i < _subscribers.size(); i++)
+    {
+        if(_subscribers[i].id == id)
+        {
+            _subscribers.erase(_subscribers.begin() + i);
+            return;
+        }
+    }
+}
+
+bool EthercatEmergency::push(const EcEmergency &emergency)
+{
+    uint64_t head = _head.load(std::memory_order_relaxed);
+
+    if(head - _tail.load(std::memory_order_acquire) > _mask)
+    {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    _ring[head & _mask] = emergency;
+    _head.store(head + 1, std::memory_order_release);
+
+    return true;
+}
+
+int EthercatEmergency::dispatch(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    int count = 0;
+    uint64_t tail = _tail.load(std::memory_order_relaxed);
+
+    while(tail != _head.load(std::memory_order_acquire))
+    {
+        EcEmergency emergency = _ring[tail & _mask];
+        // Free the slot before the callbacks run, so a slow subscriber does not fill the ring.
+        _tail.store(++tail, std::memory_order_release);
+
+        for(const _Subscriber &subscriber : _subscribers)
+        {
+            if( (subscriber.slave == 0) || (subscriber.slave == emergency.slave) )
+            {
+                subscriber.callback(emergency);
+            }
+        }
+        count++;
+    }
+
+    return count;
+}
+
+bool EthercatEmergency::start(uint32_t period_ms)
+{
+    if(_thread.joinable())
+    {
+        errorMessage = "EthercatEmergency error: dispatch thread is running already.";
+        return false;
+    }
+
+    if(period_ms < 1)
+    {
+        period_ms = 1;
+    }
+
+    _threadStop = false;
+    _thread = std::thread([this, period_ms]()
+    {
+        while(!_threadStop)
+        {
+            dispatch();
+            std::this_thread::sleep_for(std::chrono::milliseconds(period_ms));
+        }
+        dispatch();
+    });
+
+    return true;
+}
+
+void EthercatEmergency::stop(void)
+{
+    _threadStop = true;
+    if(_thread.joinable())
+    {
+        _thread.join();
+    }
+}
+
+const char* EthercatEmergency::errorClass(uint16_t error_code)
+{
+    switch(error_code >> 8)
+    {
+        case 0x00:
+            return "no error";
+        case 0x10:
+            return "generic error";
+        case 0x20: case 0x21: case 0x22: case 0x23:
+            return "current";
+        case 0x30: case 0x31: case 0x32: case 0x33:
+            return "voltage";
+        case 0x40: case 0x41: case 0x42:
+            return "temperature";
+        case 0x50:
+            return "device hardware";
+        case 0x60: case 0x61: case 0x62: case 0x63:
+            return "device software";
+        case 0x70:
+            return "additional modules";
+        case 0x80:
+            return "monitoring";
+        case 0x81:
+            return "communication";
+        case 0x82:
+            return "protocol error";
+        case 0x90:
+            return "external error";
+        case 0xF0:
+            return "additional functions";
+        case 0xFF:
+            return "device specific";
+        default:
+            return "unknown";
+    }
+}
+
+std::string EthercatEmergency::errorRegisterString(uint8_t error_register)
+{
+    static const char* const names[8] = {"generic", "current", "voltage", "temperature", "communication", "device profile", "reserved", "manufacturer"};
+
+    std::string str;
+    for(int bit = 0; bit < 8; bit++)
+    {
+        if(error_register & (1 << bit))
+        {
+            if(!str.empty())
+            {
+                str += " ";
+            }
+            str += names[bit];
+        }
+    }
+
+    return str;
+}
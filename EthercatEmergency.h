@@ -0,0 +1,143 @@
+#ifndef _ETHERCATEMERGENCY_H
+#define _ETHERCATEMERGENCY_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+// ##################################################################################
+// Data structures:
+
+// One CoE emergency message of a slave.
+struct EcEmergency
+{
+    uint16_t slave;
+
+    // Error code of CiA 301, the high byte is the error class, see EthercatEmergency::errorClass().
+    uint16_t errorCode;
+
+    // Error register, object 0x1001 of the slave at the time of the error.
+    uint8_t errorRegister;
+
+    // Manufacturer specific error field.
+    uint8_t data[5];
+
+    // Process data cycle of the master when the message was read, see EcCycleStats::cycles.
+    uint64_t cycle;
+
+    // Steady clock time in nanoseconds when the message was read.
+    uint64_t timeNs;
+};
+
+// Bits of the CiA 301 error register.
+enum EcErrorRegisterBit : uint8_t
+{
+    ERR_REG_GENERIC = 0x01,
+    ERR_REG_CURRENT = 0x02,
+    ERR_REG_VOLTAGE = 0x04,
+    ERR_REG_TEMPERATURE = 0x08,
+    ERR_REG_COMMUNICATION = 0x10,
+    ERR_REG_DEVICE_PROFILE = 0x20,
+    ERR_REG_MANUFACTURER = 0x80
+};
+
+// ###################################################################################
+// EthercatEmergency class:
+
+/**
+ * @brief Queue of CoE emergency messages with dispatch to subscribers.
+ * The mailbox scheduler (EthercatMailbox) reads the emergencies in the cyclic thread and push() them into a
+ * lock-free single producer ring, so the cyclic thread never waits for a subscriber. dispatch() delivers the
+ * queued messages to the subscribers, from the thread of start() or from an application thread.
+ * @note Attach with EthercatMailbox::setEmergencyQueue().
+ */
+class EthercatEmergency
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    typedef std::function<void(const EcEmergency&)> Callback;
+
+    EthercatEmergency(uint32_t size = 1024);
+
+    ~EthercatEmergency();
+
+    /**
+     * @brief Add a subscriber. The callback runs in the thread that calls dispatch() and must not subscribe or unsubscribe.
+     * @param slave is the slave to subscribe for, 0 for all slaves.
+     * @return id for unsubscribe().
+     */
+    int subscribe(const Callback &callback, uint16_t slave = 0);
+
+    void unsubscribe(int id);
+
+    /**
+     * @brief Queue a message. Lock-free, only one thread may push.
+     * @return false if the queue is full. The message is dropped and counted.
+     */
+    bool push(const EcEmergency &emergency);
+
+    /**
+     * @brief Deliver all queued messages to the subscribers.
+     * @return number of messages delivered.
+     */
+    int dispatch(void);
+
+    /**
+     * @brief Start a thread that calls dispatch() every period_ms.
+     * @return true if successed.
+     */
+    bool start(uint32_t period_ms = 1);
+
+    void stop(void);
+
+    // Return number of messages dropped because the queue was full.
+    uint64_t getDropped(void) {return _dropped.load(std::memory_order_relaxed);}
+
+    // Return name of the CiA 301 error class of an error code.
+    static const char* errorClass(uint16_t error_code);
+
+    // Return names of the bits set in an error register, e.g. "generic current".
+    static std::string errorRegisterString(uint8_t error_register);
+
+private:
+
+    std::unique_ptr<EcEmergency[]> _ring;
+
+    uint64_t _mask;
+
+    // Next message to write and to read.
+    std::atomic<uint64_t> _head{0};
+    std::atomic<uint64_t> _tail{0};
+
+    std::atomic<uint64_t> _dropped{0};
+
+    struct _Subscriber
+    {
+        int id;
+        uint16_t slave;
+        Callback callback;
+    };
+
+    std::vector<_Subscriber> _subscribers;
+
+    int _nextId = 1;
+
+    // Protect _subscribers, and dispatch() against itself.
+    std::mutex _mutex;
+
+    std::thread _thread;
+    std::atomic<bool> _threadStop{false};
+};
+
+#endif
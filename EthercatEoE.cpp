@@ -0,0 +1,428 @@
+#include "EthercatEoE.h"
+#include <cstring>
+#include <cerrno>
+#include "EthercatWorkers.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include <arpa/inet.h>
+
+// ##################################################################################
+// EthercatEoE class:
+
+EthercatEoE::~EthercatEoE()
+{
+    close();
+}
+
+bool EthercatEoE::open(const std::string &name)
+{
+    close();
+
+    if(name.size() >= IFNAMSIZ)
+    {
+        errorMessage = "EthercatEoE error: interface name " + name + " is too long.";
+        return false;
+    }
+
+    int fd = ::open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0)
+    {
+        errorMessage = std::string("EthercatEoE error: can not open /dev/net/tun: ") + strerror(errno);
+        return false;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    // Ethernet frames without packet information header, as they are carried by EoE.
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+
+    if(ioctl(fd, TUNSETIFF, &ifr) < 0)
+    {
+        errorMessage = std::string("EthercatEoE error: can not create TAP device: ") + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    // Bring the interface up.
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    bool up = (sock >= 0) && (ioctl(sock, SIOCGIFFLAGS, &ifr) == 0);
+    if(up)
+    {
+        ifr.ifr_flags |= IFF_UP;
+        up = (ioctl(sock, SIOCSIFFLAGS, &ifr) == 0);
+    }
+    if(sock >= 0)
+    {
+        ::close(sock);
+    }
+    if(!up)
+    {
+        errorMessage = std::string("EthercatEoE error: can not bring TAP device up: ") + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    _fd = fd;
+    _name = ifr.ifr_name;
+    _macTable.clear();
+    _tokens = _burstBytes;
+    _lastRefill = std::chrono::steady_clock::now();
+
+    _txFrames = 0;
+    _txBytes = 0;
+    _rxFrames = 0;
+    _rxBytes = 0;
+    _errors = 0;
+    _throttled = 0;
+
+    return true;
+}
+
+void EthercatEoE::close(void)
+{
+    stop();
+
+    if(_fd >= 0)
+    {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _name.clear();
+}
+
+bool EthercatEoE::addSlave(uint16_t slave)
+{
+    if( (slave < 1) || (slave > ec_slavecount) )
+    {
+        errorMessage = "EthercatEoE error: slave " + std::to_string(slave) + " is not on the bus.";
+        return false;
+    }
+
+    if( (ec_slave[slave].mbx_proto & ECT_MBXPROT_EOE) == 0 )
+    {
+        errorMessage = "EthercatEoE error: slave " + std::to_string(slave) + " does not support EoE.";
+        return false;
+    }
+
+    for(const _Slave &s : _slaves)
+    {
+        if(s.slave == slave)
+        {
+            return true;
+        }
+    }
+
+    _Slave s;
+    s.slave = slave;
+    s.lastPoll = std::chrono::steady_clock::time_point();
+    _slaves.push_back(s);
+
+    return true;
+}
+
+bool EthercatEoE::setSlaveIp(uint16_t slave, const std::string &ip, const std::string &netmask, const std::string &gateway)
+{
+    eoe_param_t param;
+    memset(&param, 0, sizeof(param));
+
+    uint32_t addr;
+    if(!_parseIp(ip, addr))
+    {
+        errorMessage = "EthercatEoE error: invalid IP address " + ip + ".";
+        return false;
+    }
+    param.ip_set = 1;
+    param.ip.addr = htoel(addr);
+
+    if(!_parseIp(netmask, addr))
+    {
+        errorMessage = "EthercatEoE error: invalid netmask " + netmask + ".";
+        return false;
+    }
+    param.subnet_set = 1;
+    param.subnet.addr = htoel(addr);
+
+    if(!gateway.empty())
+    {
+        if(!_parseIp(gateway, addr))
+        {
+            errorMessage = "EthercatEoE error: invalid gateway " + gateway + ".";
+            return false;
+        }
+        param.default_gateway_set = 1;
+        param.default_gateway.addr = htoel(addr);
+    }
+
+    int wkc;
+    {
+        // Own error list, the caller may run beside other mailbox users.
+        EthercatWorkers::Context context;
+        std::lock_guard<std::mutex> mailbox(EthercatWorkers::mailbox(slave));
+        wkc = ecx_EOEsetIp(EthercatWorkers::context(), slave, 0, &param, EC_TIMEOUTRXM);
+    }
+
+    if(wkc <= 0)
+    {
+        errorMessage = "EthercatEoE error: set IP request to slave " + std::to_string(slave) + " failed.";
+        return false;
+    }
+
+    return true;
+}
+
+void EthercatEoE::setRateLimit(uint32_t bytes_per_second, uint32_t burst_bytes)
+{
+    _bytesPerSecond = bytes_per_second;
+    _burstBytes = (burst_bytes < (uint32_t)_FRAME_SIZE) ? (uint32_t)_FRAME_SIZE : burst_bytes;
+}
+
+bool EthercatEoE::service(void)
+{
+    if(_fd < 0)
+    {
+        errorMessage = "EthercatEoE error: TAP device is not open.";
+        return false;
+    }
+
+    uint8_t frame[_FRAME_SIZE];
+
+    _refill();
+
+    // TAP device to slaves.
+    while(_tokens > 0)
+    {
+        ssize_t size = read(_fd, frame, sizeof(frame));
+        if(size < 0)
+        {
+            if( (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) )
+            {
+                break;
+            }
+            errorMessage = std::string("EthercatEoE error: TAP device read failed: ") + strerror(errno);
+            return false;
+        }
+        if(size < 14)
+        {
+            continue;
+        }
+
+        auto it = _macTable.end();
+        // Group bit of the destination is clear for unicast.
+        if( (frame[0] & 0x01) == 0 )
+        {
+            it = _macTable.find(_mac(frame));
+        }
+
+        if(it != _macTable.end())
+        {
+            _send(it->second, frame, (int)size);
+        }
+        else
+        {
+            for(const _Slave &s : _slaves)
+            {
+                _send(s.slave, frame, (int)size);
+            }
+        }
+    }
+
+    // Slaves to TAP device.
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for(_Slave &s : _slaves)
+    {
+        if(_tokens <= 0)
+        {
+            break;
+        }
+
+        if(std::chrono::duration_cast<std::chrono::microseconds>(now - s.lastPoll).count() < _pollPeriodUs)
+        {
+            continue;
+        }
+        s.lastPoll = now;
+
+        // A message in a mailbox owned by a transfer belongs to that transfer, poll again next period.
+        std::unique_lock<std::mutex> mailbox(EthercatWorkers::mailbox(s.slave), std::try_to_lock);
+        if(!mailbox.owns_lock())
+        {
+            continue;
+        }
+
+        // An empty mailbox is no error. Once the first fragment is there, the slave sends the rest of the frame 
+        // as fast as it can, so the fragments get the normal mailbox timeout.
+        if(!_mailboxFull(s.slave))
+        {
+            continue;
+        }
+
+        int size = sizeof(frame);
+        int wkc = ecx_EOErecv(EthercatWorkers::context(), s.slave, 0, &size, frame, EC_TIMEOUTRXM);
+        if( (wkc <= 0) || (size < 14) )
+        {
+            continue;
+        }
+
+        // Learn the slave behind the source address.
+        _macTable[_mac(frame + 6)] = s.slave;
+
+        if(write(_fd, frame, size) == size)
+        {
+            _rxFrames.fetch_add(1, std::memory_order_relaxed);
+            _rxBytes.fetch_add(size, std::memory_order_relaxed);
+        }
+        else
+        {
+            _errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        _tokens -= size;
+    }
+
+    if(_tokens <= 0)
+    {
+        _throttled.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return true;
+}
+
+bool EthercatEoE::start(void)
+{
+    if(_fd < 0)
+    {
+        errorMessage = "EthercatEoE error: TAP device is not open.";
+        return false;
+    }
+
+    if(_thread.joinable())
+    {
+        return true;
+    }
+
+    _threadStop = false;
+    _thread = std::thread([this]()
+    {
+        // Mailbox errors of the bridge go into a list of its own, not into the one of ecx_context.
+        EthercatWorkers::Context context;
+
+        // Wake up for frames from the TAP device, or after one poll period for the slave mailboxes.
+        int timeout_ms = (int)(_pollPeriodUs / 1000);
+        if(timeout_ms < 1)
+        {
+            timeout_ms = 1;
+        }
+
+        while(!_threadStop)
+        {
+            struct pollfd pfd;
+            pfd.fd = _fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            // Without tokens pending frames would wake the thread at once, wait for the refill instead.
+            ::poll(&pfd, (_tokens > 0) ? 1 : 0, timeout_ms);
+
+            if(!service())
+            {
+                break;
+            }
+        }
+    });
+
+    return true;
+}
+
+void EthercatEoE::stop(void)
+{
+    _threadStop = true;
+    if(_thread.joinable())
+    {
+        _thread.join();
+    }
+}
+
+EcEoeStats EthercatEoE::getStats(void)
+{
+    EcEoeStats stats;
+    stats.txFrames = _txFrames.load(std::memory_order_relaxed);
+    stats.txBytes = _txBytes.load(std::memory_order_relaxed);
+    stats.rxFrames = _rxFrames.load(std::memory_order_relaxed);
+    stats.rxBytes = _rxBytes.load(std::memory_order_relaxed);
+    stats.errors = _errors.load(std::memory_order_relaxed);
+    stats.throttled = _throttled.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void EthercatEoE::_refill(void)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    int64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(now - _lastRefill).count();
+
+    // Time is kept until it earns a whole byte, so slow rates are not rounded down to zero.
+    int64_t add = elapsed_us * _bytesPerSecond / 1000000;
+    if(add <= 0)
+    {
+        return;
+    }
+
+    _tokens += add;
+    if(_tokens > _burstBytes)
+    {
+        _tokens = _burstBytes;
+    }
+    _lastRefill = now;
+}
+
+void EthercatEoE::_send(uint16_t slave, uint8_t *frame, int size)
+{
+    int wkc;
+    {
+        std::lock_guard<std::mutex> mailbox(EthercatWorkers::mailbox(slave));
+        wkc = ecx_EOEsend(EthercatWorkers::context(), slave, 0, size, frame, EC_TIMEOUTRXM);
+    }
+
+    if(wkc > 0)
+    {
+        _txFrames.fetch_add(1, std::memory_order_relaxed);
+        _txBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    else
+    {
+        _errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    _tokens -= size;
+}
+
+bool EthercatEoE::_mailboxFull(uint16_t slave)
+{
+    uint8 status = 0;
+    int wkc = ec_FPRD(ec_slave[slave].configadr, ECT_REG_SM1STAT, sizeof(status), &status, _RECV_TIMEOUT_US);
+    return (wkc > 0) && ((status & 0x08) != 0);
+}
+
+uint64_t EthercatEoE::_mac(const uint8_t *addr)
+{
+    uint64_t mac = 0;
+    for(int i = 0; i < 6; i++)
+    {
+        mac = (mac << 8) | addr[i];
+    }
+    return mac;
+}
+
+bool EthercatEoE::_parseIp(const std::string &text, uint32_t &addr)
+{
+    struct in_addr in;
+    if(inet_pton(AF_INET, text.c_str(), &in) != 1)
+    {
+        return false;
+    }
+
+    // EoE takes the address as host order number, see EOE_IP4_ADDR_TO_U32 of SOEM.
+    addr = ntohl(in.s_addr);
+    return true;
+}
@@ -0,0 +1,173 @@
+#ifndef _ETHERCATEOE_H
+#define _ETHERCATEOE_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "ethercat.h"
+
+// ##################################################################################
+// Data structures:
+
+// Counters of the EoE bridge since open().
+struct EcEoeStats
+{
+    // Ethernet frames and bytes from the TAP device to the slaves.
+    uint64_t txFrames = 0;
+    uint64_t txBytes = 0;
+
+    // Ethernet frames and bytes from the slaves to the TAP device.
+    uint64_t rxFrames = 0;
+    uint64_t rxBytes = 0;
+
+    // Mailbox transfers that failed.
+    uint64_t errors = 0;
+
+    // Calls of service() that stopped early because the rate limit was reached.
+    uint64_t throttled = 0;
+};
+
+// ###################################################################################
+// EthercatEoE class:
+
+/**
+ * @brief Ethernet over EtherCAT (EoE) bridge between a Linux TAP device and the mailboxes of slaves.
+ * Frames written to the TAP device go to the slave that sent from the destination MAC address before,
+ * broadcast and unknown destinations go to all bridged slaves. Frames from the slaves are written to the TAP
+ * device. Give the TAP device an address in the subnet of the slaves, or add it to a Linux bridge.
+ *
+ * EoE transfers of SOEM are blocking mailbox transfers with their own frames between the process data frames,
+ * so the bridge runs in its own thread and not in updateProccess(). A token bucket limits the bytes per second
+ * of both directions and each slave mailbox is read at most once per poll period, so bulk traffic keeps a
+ * bounded share of the line beside the process data.
+ * The bridge owns the mailbox of a slave (EthercatWorkers::mailbox()) for each transfer, so SDO transfers from
+ * other threads and the mailbox scheduler can run meanwhile. A poll skips a slave whose mailbox is owned.
+ * @note Call after SimpleEthercat::configSlaves().
+ */
+class EthercatEoE
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    ~EthercatEoE();
+
+    /**
+     * @brief Create the TAP device and bring it up. Needs CAP_NET_ADMIN.
+     * @param name is the interface name, e.g. "eoe0". Empty lets the kernel choose one.
+     * @return true if successed.
+     */
+    bool open(const std::string &name = "");
+
+    // Stop the bridge and delete the TAP device.
+    void close(void);
+
+    // Return interface name of the TAP device.
+    const std::string& getName(void) {return _name;}
+
+    /**
+     * @brief Add a slave to the bridge. Call before start().
+     * @return true if successed. false if the slave does not support EoE.
+     */
+    bool addSlave(uint16_t slave);
+
+    /**
+     * @brief Set IP parameters of a slave with an EoE set IP request. Addresses are in dotted decimal notation.
+     * Empty gateway leaves the gateway of the slave unchanged.
+     * @return true if successed.
+     */
+    bool setSlaveIp(uint16_t slave, const std::string &ip, const std::string &netmask, const std::string &gateway = "");
+
+    /**
+     * @brief Set rate limit of both directions together. Default is 1 MB/s.
+     * @param burst_bytes is the size of the token bucket, at least one Ethernet frame.
+     */
+    void setRateLimit(uint32_t bytes_per_second, uint32_t burst_bytes = 16384);
+
+    // Set minimum time between two reads of the mailbox of a slave. Default is 2000 us.
+    void setPollPeriod(uint32_t period_us) {_pollPeriodUs = period_us;}
+
+    /**
+     * @brief Move pending frames in both directions as far as the rate limit allows. Does not block on the TAP device.
+     * Called by the thread of start(), or periodically by an application thread instead. That thread should hold
+     * an EthercatWorkers::Context, else mailbox errors go into the error list of ecx_context.
+     * @return false if the TAP device failed.
+     */
+    bool service(void);
+
+    /**
+     * @brief Start the bridge thread.
+     * @return true if successed.
+     */
+    bool start(void);
+
+    // Stop the bridge thread.
+    void stop(void);
+
+    // Return counters of the bridge. May be called from any thread.
+    EcEoeStats getStats(void);
+
+private:
+
+    // Largest Ethernet frame with VLAN tag, without frame check sequence.
+    static const int _FRAME_SIZE = 1518;
+
+    // Timeout of the SM1 status read in microseconds, it finds an empty mailbox. The fragments of a frame are 
+    // read with the normal mailbox timeout EC_TIMEOUTRXM.
+    static const int _RECV_TIMEOUT_US = 500;
+
+    int _fd = -1;
+
+    std::string _name;
+
+    struct _Slave
+    {
+        uint16_t slave;
+        std::chrono::steady_clock::time_point lastPoll;
+    };
+
+    std::vector<_Slave> _slaves;
+
+    // Slave behind each MAC address seen in frames from the slaves, key is the MAC as integer.
+    std::unordered_map<uint64_t, uint16_t> _macTable;
+
+    uint32_t _bytesPerSecond = 1000000;
+    uint32_t _burstBytes = 16384;
+    uint32_t _pollPeriodUs = 2000;
+
+    // Token bucket in bytes. Goes negative after a frame larger than the tokens, the debt is paid first.
+    int64_t _tokens = 16384;
+    std::chrono::steady_clock::time_point _lastRefill;
+
+    std::atomic<uint64_t> _txFrames{0};
+    std::atomic<uint64_t> _txBytes{0};
+    std::atomic<uint64_t> _rxFrames{0};
+    std::atomic<uint64_t> _rxBytes{0};
+    std::atomic<uint64_t> _errors{0};
+    std::atomic<uint64_t> _throttled{0};
+
+    std::thread _thread;
+    std::atomic<bool> _threadStop{false};
+
+    void _refill(void);
+
+    // Send a frame from the TAP device to one slave.
+    void _send(uint16_t slave, uint8_t *frame, int size);
+
+    // Return true if the slave has a message in its input mailbox (SM1 full).
+    static bool _mailboxFull(uint16_t slave);
+
+    static uint64_t _mac(const uint8_t *addr);
+
+    static bool _parseIp(const std::string &text, uint32_t &addr);
+};
+
+#endif
@@ -0,0 +1,237 @@
+#include "EthercatFoE.h"
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#include "EthercatWorkers.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ##################################################################################
+// EthercatFoE class:
+
+std::atomic<EthercatFoE*> EthercatFoE::_active(nullptr);
+
+EthercatFoE::~EthercatFoE()
+{
+    close();
+}
+
+bool EthercatFoE::open(const std::string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        errorMessage = "EthercatFoE error: can not open " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        errorMessage = "EthercatFoE error: can not read size of " + path + ": " + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    // ec_FOEwrite() takes the size as int.
+    if( (st.st_size <= 0) || (st.st_size > INT_MAX) )
+    {
+        errorMessage = "EthercatFoE error: size of " + path + " is out of range.";
+        ::close(fd);
+        return false;
+    }
+
+    void *image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid without the file descriptor.
+    ::close(fd);
+
+    if(image == MAP_FAILED)
+    {
+        errorMessage = "EthercatFoE error: can not map " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    // Segments are read once from front to back, let the kernel read ahead and drop pages behind.
+    madvise(image, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    _image = (const uint8_t*)image;
+    _size = (uint32_t)st.st_size;
+
+    return true;
+}
+
+void EthercatFoE::close(void)
+{
+    if(_image != nullptr)
+    {
+        munmap((void*)_image, _size);
+        _image = nullptr;
+        _size = 0;
+    }
+}
+
+bool EthercatFoE::flash(const std::vector<uint16_t> &slaves, const std::string &filename, uint32_t password)
+{
+    if(_image == nullptr)
+    {
+        errorMessage = "EthercatFoE error: no image, open() was not called.";
+        return false;
+    }
+
+    for(uint16_t slave : slaves)
+    {
+        if( (slave < 1) || (slave > ec_slavecount) )
+        {
+            errorMessage = "EthercatFoE error: slave " + std::to_string(slave) + " is not on the bus.";
+            return false;
+        }
+    }
+
+    // SOEM has one FoE hook for all transfers.
+    EthercatFoE *expected = nullptr;
+    if(!_active.compare_exchange_strong(expected, this))
+    {
+        errorMessage = "EthercatFoE error: another flash() is running.";
+        return false;
+    }
+
+    _results.assign(slaves.size(), EcFoeResult());
+    for(uint16_t slave : slaves)
+    {
+        _progress[slave].store(0, std::memory_order_relaxed);
+    }
+
+    ec_FOEdefinehook((void*)&EthercatFoE::_foeHook);
+
+    // Each slave is flashed by its own worker. Their contexts are taken after the hook is defined.
+    EthercatWorkers::run(slaves.size(), _maxParallel, [&](size_t i)
+    {
+        EcFoeResult &result = _results[i];
+        auto start = std::chrono::steady_clock::now();
+
+        result.slave = slaves[i];
+        result.ok = _flashSlave(slaves[i], filename, password, result.error);
+        result.durationUs = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - start).count();
+    });
+
+    ec_FOEdefinehook(NULL);
+    _active.store(nullptr);
+
+    for(const EcFoeResult &result : _results)
+    {
+        if(!result.ok)
+        {
+            errorMessage = "EthercatFoE error: slave " + std::to_string(result.slave) + ": " + result.error;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int EthercatFoE::_foeHook(uint16 slave, int packetnumber, int datasize)
+{
+    (void)packetnumber;
+
+    EthercatFoE *foe = _active.load(std::memory_order_relaxed);
+
+    // SOEM reports the bytes that are left to send.
+    if( (foe != nullptr) && (slave < EC_MAXSLAVE) && (datasize >= 0) && ((uint32_t)datasize <= foe->_size) )
+    {
+        foe->_progress[slave].store(foe->_size - (uint32_t)datasize, std::memory_order_relaxed);
+    }
+
+    return 0;
+}
+
+bool EthercatFoE::_flashSlave(uint16_t slave, std::string filename, uint32_t password, std::string &error)
+{
+    // The mailbox is moved to the bootstrap mailbox for the update, nobody else may use it meanwhile.
+    std::lock_guard<std::mutex> mailbox(EthercatWorkers::mailbox(slave));
+
+    // BOOT can only be entered from INIT.
+    if(!_slaveState(slave, EC_STATE_INIT, EC_TIMEOUTSTATE))
+    {
+        error = "can not switch to INIT.";
+        return false;
+    }
+
+    // Mailbox of the application firmware, restored after the update.
+    ec_slavet &s = ec_slave[slave];
+    ec_smt sm0 = s.SM[0];
+    ec_smt sm1 = s.SM[1];
+    uint16 mbx_wo = s.mbx_wo;
+    uint16 mbx_l = s.mbx_l;
+    uint16 mbx_ro = s.mbx_ro;
+    uint16 mbx_rl = s.mbx_rl;
+
+    // The bootloader has its own mailbox, given by the bootstrap words of the SII.
+    uint32 data = ec_readeeprom(slave, ECT_SII_BOOTRXMBX, EC_TIMEOUTEEP);
+    s.SM[0].StartAddr = (uint16)LO_WORD(data);
+    s.SM[0].SMlength = (uint16)HI_WORD(data);
+    s.mbx_wo = (uint16)LO_WORD(data);
+    s.mbx_l = (uint16)HI_WORD(data);
+
+    data = ec_readeeprom(slave, ECT_SII_BOOTTXMBX, EC_TIMEOUTEEP);
+    s.SM[1].StartAddr = (uint16)LO_WORD(data);
+    s.SM[1].SMlength = (uint16)HI_WORD(data);
+    s.mbx_ro = (uint16)LO_WORD(data);
+    s.mbx_rl = (uint16)HI_WORD(data);
+
+    bool ok = false;
+
+    if( (s.mbx_l == 0) || (s.mbx_rl == 0) )
+    {
+        error = "no bootstrap mailbox in the SII.";
+    }
+    else
+    {
+        ec_FPWR(s.configadr, ECT_REG_SM0, sizeof(ec_smt), &s.SM[0], EC_TIMEOUTRET);
+        ec_FPWR(s.configadr, ECT_REG_SM1, sizeof(ec_smt), &s.SM[1], EC_TIMEOUTRET);
+
+        if(!_slaveState(slave, EC_STATE_BOOT, EC_TIMEOUTSTATE * 5))
+        {
+            error = "can not switch to BOOT.";
+        }
+        // SOEM only reads from the image, the mapping is read-only.
+        else if(ecx_FOEwrite(EthercatWorkers::context(), slave, &filename[0], password, (int)_size, (void*)_image, _segmentTimeout) <= 0)
+        {
+            error = "FoE write failed.";
+        }
+        else
+        {
+            _progress[slave].store(_size, std::memory_order_relaxed);
+            ok = true;
+        }
+
+        // Leave BOOT in any case, the new firmware starts from INIT.
+        if(!_slaveState(slave, EC_STATE_INIT, EC_TIMEOUTSTATE * 5) && ok)
+        {
+            error = "can not switch back to INIT.";
+            ok = false;
+        }
+    }
+
+    s.SM[0] = sm0;
+    s.SM[1] = sm1;
+    s.mbx_wo = mbx_wo;
+    s.mbx_l = mbx_l;
+    s.mbx_ro = mbx_ro;
+    s.mbx_rl = mbx_rl;
+
+    return ok;
+}
+
+bool EthercatFoE::_slaveState(uint16_t slave, uint16 state, int timeout_us)
+{
+    ec_slave[slave].state = state;
+    ec_writestate(slave);
+
+    return (ec_statecheck(slave, state, timeout_us) == state);
+}
@@ -0,0 +1,109 @@
+#ifndef _ETHERCATFOE_H
+#define _ETHERCATFOE_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <vector>
+#include <atomic>
+#include "ethercat.h"
+
+// ##################################################################################
+// Data structures:
+
+// Result of the firmware update of one slave.
+struct EcFoeResult
+{
+    uint16_t slave;
+
+    bool ok;
+
+    // Time from the INIT request until the slave was back in INIT.
+    uint32_t durationUs;
+
+    std::string error;
+};
+
+// ###################################################################################
+// EthercatFoE class:
+
+/**
+ * @brief Firmware update over File access over EtherCAT (FoE).
+ * The image file is memory-mapped and SOEM cuts the mailbox segments straight from the mapping, so the image
+ * is never copied into memory as a whole and one mapping serves all slaves. flash() updates several slaves at
+ * once, each slave in its own worker: INIT, bootstrap mailbox from the SII, BOOT, FoE write and back to INIT.
+ * Progress of each slave is updated by the FoE hook of SOEM and can be read from any thread.
+ * @note Call after SimpleEthercat::configSlaves() and before configMap(), without cyclic exchange.
+ * Slaves start the new firmware at their next power up or INIT to PRE_OP transition, so call configSlaves()
+ * again after flash().
+ */
+class EthercatFoE
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    ~EthercatFoE();
+
+    /**
+     * @brief Map the image file read-only.
+     * @return true if successed.
+     */
+    bool open(const std::string &path);
+
+    // Unmap the image file.
+    void close(void);
+
+    /**
+     * @brief Write the image to the slaves, setMaxParallel() slaves at the same time.
+     * @param filename is the file name sent to the slaves, as expected by the device, e.g. "app.efw".
+     * @param password is the FoE password, 0 for most devices.
+     * @return true if all slaves successed. See getResults() for each slave.
+     */
+    bool flash(const std::vector<uint16_t> &slaves, const std::string &filename, uint32_t password = 0);
+
+    // Set maximum number of slaves that are flashed at the same time. Default is 8.
+    void setMaxParallel(int num) {_maxParallel = (num < 1) ? 1 : num;}
+
+    // Set timeout of one FoE segment in microseconds. Default is EC_TIMEOUTSTATE.
+    void setSegmentTimeout(int timeout_us) {_segmentTimeout = timeout_us;}
+
+    // Return size of the mapped image in bytes.
+    uint32_t getSize(void) {return _size;}
+
+    // Return bytes of the image the slave has acknowledged so far. May be called from any thread during flash().
+    uint32_t getProgress(uint16_t slave) {return (slave < EC_MAXSLAVE) ? _progress[slave].load(std::memory_order_relaxed) : 0;}
+
+    // Return per slave results of the last flash().
+    const std::vector<EcFoeResult>& getResults(void) {return _results;}
+
+private:
+
+    const uint8_t *_image = nullptr;
+
+    uint32_t _size = 0;
+
+    int _maxParallel = 8;
+
+    int _segmentTimeout = EC_TIMEOUTSTATE;
+
+    std::atomic<uint32_t> _progress[EC_MAXSLAVE] = {};
+
+    std::vector<EcFoeResult> _results;
+
+    // Object that runs flash(), for the FoE hook of SOEM that has no user pointer.
+    static std::atomic<EthercatFoE*> _active;
+
+    static int _foeHook(uint16 slave, int packetnumber, int datasize);
+
+    // Bring one slave to BOOT, write the image and bring it back to INIT.
+    bool _flashSlave(uint16_t slave, std::string filename, uint32_t password, std::string &error);
+
+    // Request a state for one slave and wait for it.
+    static bool _slaveState(uint16_t slave, uint16 state, int timeout_us);
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "EthercatInterpolator.h"
+
+// ##################################################################################
+// EthercatInterpolator class:
+
+bool EthercatInterpolator::init(EthercatCia402 &drives, double cycle_time, double segment_time, EcInterpolation type, uint32_t fifo_size)
+{
+    if( (cycle_time <= 0) || (segment_time < cycle_time) )
+    {
+        errorMessage = "EthercatInterpolator error: segment time must not be shorter than cycle time.";
+        return false;
+    }
+
+    if( (fifo_size < 2) || (fifo_size > 0x10000) )
+    {
+        errorMessage = "EthercatInterpolator error: fifo size is out of range.";
+        return false;
+    }
+
+    uint32_t size = 1;
+    while(size < fifo_size)
+    {
+        size <<= 1;
+    }
+
+    _drives = &drives;
+    _type = type;
+    _cycleTime = cycle_time;
+    _segmentTime = segment_time;
+    _axisCount = (size_t)drives.getAxisCount();
+    _fifoMask = size - 1;
+
+    _fifo.reset(new _Fifo[_axisCount]);
+    _buffer.assign(_axisCount * size, EcSetpoint());
+
+    _c0.assign(_axisCount, 0);
+    _c1.assign(_axisCount, 0);
+    _c2.assign(_axisCount, 0);
+    _c3.assign(_axisCount, 0);
+    _c4.assign(_axisCount, 0);
+    _c5.assign(_axisCount, 0);
+    _time.assign(_axisCount, 0);
+    _end.assign(_axisCount, EcSetpoint());
+    _moving.assign(_axisCount, 0);
+    _underruns.assign(_axisCount, 0);
+
+    for(size_t i = 0; i < _axisCount; i++)
+    {
+        _hold(i, drives.getPositionActual((int)i));
+    }
+
+    return true;
+}
+
+bool EthercatInterpolator::push(int axis, const EcSetpoint &setpoint)
+{
+    if( (axis < 0) || ((size_t)axis >= _axisCount) )
+    {
+        return false;
+    }
+
+    _Fifo &fifo = _fifo[axis];
+    uint32_t tail = fifo.tail.load(std::memory_order_relaxed);
+
+    if(tail - fifo.head.load(std::memory_order_acquire) > _fifoMask)
+    {
+        return false;
+    }
+
+    _buffer[(size_t)axis * (_fifoMask + 1) + (tail & _fifoMask)] = setpoint;
+    fifo.tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+uint32_t EthercatInterpolator::getQueued(int axis)
+{
+    if( (axis < 0) || ((size_t)axis >= _axisCount) )
+    {
+        return 0;
+    }
+
+    return _fifo[axis].tail.load(std::memory_order_acquire) - _fifo[axis].head.load(std::memory_order_acquire);
+}
+
+void EthercatInterpolator::update(void)
+{
+    const size_t n = _axisCount;
+
+    if( (_drives == nullptr) || (n == 0) )
+    {
+        return;
+    }
+
+    // Segment changes. Only a compare per axis in most cycles, a new segment every segment_time.
+    for(size_t i = 0; i < n; i++)
+    {
+        if(!_drives->isEnabled((int)i))
+        {
+            _hold(i, _drives->getPositionActual((int)i));
+            continue;
+        }
+
+        _time[i] += _cycleTime;
+
+        // Half a cycle tolerance, so rounding never skips or doubles a cycle of a segment.
+        // A holding axis checks its FIFO every cycle and starts moving without delay.
+        if( _moving[i] && (_time[i] < _segmentTime - 0.5 * _cycleTime) )
+        {
+            continue;
+        }
+
+        _time[i] = _moving[i] ? (_time[i] - _segmentTime) : 0;
+
+        EcSetpoint setpoint;
+        if(_pop(i, setpoint))
+        {
+            _segment(i, setpoint);
+            _moving[i] = 1;
+        }
+        else
+        {
+            // Running empty after a setpoint with zero velocity is a planned stop.
+            if( _moving[i] && (_end[i].velocity != 0) )
+            {
+                _underruns[i]++;
+            }
+            _hold(i, _end[i].position);
+        }
+    }
+
+    // Evaluate all segment polynomials and write the targets.
+    const double *__restrict c0 = _c0.data();
+    const double *__restrict c1 = _c1.data();
+    const double *__restrict c2 = _c2.data();
+    const double *__restrict c3 = _c3.data();
+    const double *__restrict c4 = _c4.data();
+    const double *__restrict c5 = _c5.data();
+    const double *__restrict t = _time.data();
+    int32_t *__restrict target = _drives->targetPositions();
+
+    for(size_t i = 0; i < n; i++)
+    {
+        double p = c0[i] + t[i] * (c1[i] + t[i] * (c2[i] + t[i] * (c3[i] + t[i] * (c4[i] + t[i] * c5[i]))));
+        // Round to nearest count.
+        target[i] = (int32_t)(p + ((p < 0) ? -0.5 : 0.5));
+    }
+}
+
+bool EthercatInterpolator::_pop(size_t axis, EcSetpoint &setpoint)
+{
+    _Fifo &fifo = _fifo[axis];
+    uint32_t head = fifo.head.load(std::memory_order_relaxed);
+
+    if(head == fifo.tail.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    setpoint = _buffer[axis * (_fifoMask + 1) + (head & _fifoMask)];
+    fifo.head.store(head + 1, std::memory_order_release);
+
+    return true;
+}
+
+void EthercatInterpolator::_hold(size_t axis, double position)
+{
+    _c0[axis] = position;
+    _c1[axis] = 0;
+    _c2[axis] = 0;
+    _c3[axis] = 0;
+    _c4[axis] = 0;
+    _c5[axis] = 0;
+    _end[axis] = EcSetpoint();
+    _end[axis].position = position;
+    _moving[axis] = 0;
+}
+
+void EthercatInterpolator::_segment(size_t axis, const EcSetpoint &target)
+{
+    const EcSetpoint &start = _end[axis];
+    const double T = _segmentTime;
+    const double h = target.position - start.position;
+
+    _c0[axis] = start.position;
+
+    switch(_type)
+    {
+        case INTERP_LINEAR:
+            _c1[axis] = h / T;
+            _c2[axis] = 0;
+            _c3[axis] = 0;
+            _c4[axis] = 0;
+            _c5[axis] = 0;
+        break;
+        case INTERP_CUBIC:
+            // Hermite segment: position and velocity at both ends.
+            _c1[axis] = start.velocity;
+            _c2[axis] = (3 * h - (2 * start.velocity + target.velocity) * T) / (T * T);
+            _c3[axis] = (-2 * h + (start.velocity + target.velocity) * T) / (T * T * T);
+            _c4[axis] = 0;
+            _c5[axis] = 0;
+        break;
+        case INTERP_QUINTIC:
+            // Position, velocity and acceleration at both ends.
+            _c1[axis] = start.velocity;
+            _c2[axis] = 0.5 * start.acceleration;
+            _c3[axis] = (20 * h - (8 * target.velocity + 12 * start.velocity) * T - (3 * start.acceleration - target.acceleration) * T * T) / (2 * T * T * T);
+            _c4[axis] = (-30 * h + (14 * target.velocity + 16 * start.velocity) * T + (3 * start.acceleration - 2 * target.acceleration) * T * T) / (2 * T * T * T * T);
+            _c5[axis] = (12 * h - 6 * (target.velocity + start.velocity) * T + (target.acceleration - start.acceleration) * T * T) / (2 * T * T * T * T * T);
+        break;
+    }
+
+    _end[axis] = target;
+}
@@ -0,0 +1,130 @@
+#ifndef _ETHERCATINTERPOLATOR_H
+#define _ETHERCATINTERPOLATOR_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include "EthercatCia402.h"
+
+// ##################################################################################
+// Data structures:
+
+// Interpolation between two setpoints of the planner.
+enum EcInterpolation : uint8_t
+{
+    // Constant velocity, uses position only.
+    INTERP_LINEAR = 0,
+    // Continuous velocity, uses position and velocity.
+    INTERP_CUBIC,
+    // Continuous acceleration, uses position, velocity and acceleration.
+    INTERP_QUINTIC
+};
+
+// One setpoint of the planner. Units are position counts and seconds.
+struct EcSetpoint
+{
+    double position;
+    double velocity = 0;
+    double acceleration = 0;
+};
+
+// ###################################################################################
+// EthercatInterpolator class:
+
+/**
+ * @brief Interpolation of slow planner setpoints into the position targets of CiA 402 axes.
+ * The planner pushes one setpoint per axis and segment time (e.g. 10 ms) into a lock-free FIFO of that axis.
+ * update() runs in the cyclic thread: it takes the next setpoint of an axis when its segment is finished and
+ * evaluates the segment polynomials of all axes at the current time. Linear, cubic and quintic segments all
+ * use the same 5th order coefficient arrays, so the evaluation is one pass over structure-of-arrays data
+ * that the compiler turns into vector code.
+ * An axis that is not enabled holds its actual position and does not consume setpoints. When its FIFO runs
+ * empty an axis stops at the last setpoint, if that setpoint still had a velocity an underrun is counted.
+ * @note Each FIFO has one producer and one consumer: push() for an axis from one planner thread only,
+ * update() from the cyclic thread only. Call update() right before EthercatCia402::update().
+ */
+class EthercatInterpolator
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    /**
+     * @brief Bind to all axes of drives. Call after all axes were added.
+     * @param cycle_time is the bus cycle time in seconds.
+     * @param segment_time is the time between two planner setpoints in seconds.
+     * @param fifo_size is the FIFO capacity of each axis, rounded up to a power of 2.
+     * @return true if successed.
+     */
+    bool init(EthercatCia402 &drives, double cycle_time, double segment_time, EcInterpolation type = INTERP_CUBIC, uint32_t fifo_size = 64);
+
+    /**
+     * @brief Queue a setpoint for an axis. Called by the planner thread.
+     * @return false if the FIFO of the axis is full.
+     */
+    bool push(int axis, const EcSetpoint &setpoint);
+
+    // Return number of queued setpoints of an axis.
+    uint32_t getQueued(int axis);
+
+    // Interpolate and write the position targets of all axes. Call once per cycle.
+    void update(void);
+
+    // Return number of times an axis found its FIFO empty while moving. Read from the cyclic thread.
+    uint32_t getUnderruns(int axis) {return _underruns[axis];}
+
+private:
+
+    // Single producer single consumer ring indices. Head and tail in separate cache lines.
+    struct _Fifo
+    {
+        alignas(64) std::atomic<uint32_t> head{0};
+        alignas(64) std::atomic<uint32_t> tail{0};
+    };
+
+    EthercatCia402 *_drives = nullptr;
+
+    EcInterpolation _type = INTERP_CUBIC;
+
+    double _cycleTime = 0;
+    double _segmentTime = 0;
+
+    size_t _axisCount = 0;
+
+    uint32_t _fifoMask = 0;
+
+    std::unique_ptr<_Fifo[]> _fifo;
+
+    // Setpoint storage, fifo_size elements per axis.
+    std::vector<EcSetpoint> _buffer;
+
+    // Segment polynomial p(t) = c0 + c1 t + ... + c5 t^5 of each axis.
+    std::vector<double> _c0, _c1, _c2, _c3, _c4, _c5;
+
+    // Time inside the current segment of each axis.
+    std::vector<double> _time;
+
+    // End of the current segment, start of the next one.
+    std::vector<EcSetpoint> _end;
+
+    // 1 while the current segment comes from a setpoint.
+    std::vector<uint8_t> _moving;
+
+    std::vector<uint32_t> _underruns;
+
+    bool _pop(size_t axis, EcSetpoint &setpoint);
+
+    // Set the segment of an axis to hold position.
+    void _hold(size_t axis, double position);
+
+    // Compute the segment of an axis from _end[axis] to target.
+    void _segment(size_t axis, const EcSetpoint &target);
+};
+
+#endif
@@ -0,0 +1,602 @@
+#include "EthercatMailbox.h"
+#include <cstring>
+#include "EthercatWorkers.h"
+
+// ##################################################################################
+// CoE mailbox frames:
+
+// Layouts of ec_SDOt and ec_emcyt of SOEM, which are not public.
+#pragma pack(push, 1)
+struct EcSdoFrame
+{
+    ec_mbxheadert header;
+    uint16 canopen;
+    uint8 command;
+    uint16 index;
+    uint8 subindex;
+    uint8 data[EC_MAXMBX - 12];
+};
+
+struct EcEmergencyFrame
+{
+    ec_mbxheadert header;
+    uint16 canopen;
+    uint16 errorCode;
+    uint8 errorRegister;
+    uint8 data1;
+    uint16 data2;
+    uint16 data3;
+};
+#pragma pack(pop)
+
+// Mailbox header, CoE header and SDO header in front of the data of a normal transfer.
+static const uint32_t SDO_OVERHEAD = 16;
+
+// ##################################################################################
+// EthercatMailbox class:
+
+std::future<EcMailboxResult> EthercatMailbox::read(uint16 slave, uint16 index, uint8 subindex, EcMailboxPriority priority)
+{
+    if( (slave < 1) || (slave > ec_slavecount) || (priority >= MBX_PRIORITY_NUM) )
+    {
+        return _failedFuture("invalid request", "EthercatMailbox error: slave " + std::to_string(slave) + " is not on the bus.");
+    }
+
+    std::list<_Job> job(1);
+    _Job &j = job.front();
+    j.slave = slave;
+    j.index = index;
+    j.subindex = subindex;
+    j.write = false;
+    j.priority = priority;
+    // Room for the largest normal upload, the cyclic thread only copies into it.
+    j.data.reserve(ec_slave[slave].mbx_rl);
+
+    return _submit(job);
+}
+
+std::future<EcMailboxResult> EthercatMailbox::write(uint16 slave, uint16 index, uint8 subindex, const void *data, uint32_t size,
+                                                    EcMailboxPriority priority)
+{
+    if( (slave < 1) || (slave > ec_slavecount) || (priority >= MBX_PRIORITY_NUM) || (size == 0) )
+    {
+        return _failedFuture("invalid request", "EthercatMailbox error: invalid write request for slave " + std::to_string(slave) + ".");
+    }
+
+    if(size + SDO_OVERHEAD > ec_slave[slave].mbx_l)
+    {
+        return _failedFuture("object larger than mailbox", "EthercatMailbox error: " + std::to_string(size) +
+                             " bytes do not fit into the mailbox of slave " + std::to_string(slave) + ".");
+    }
+
+    std::list<_Job> job(1);
+    _Job &j = job.front();
+    j.slave = slave;
+    j.index = index;
+    j.subindex = subindex;
+    j.write = true;
+    j.priority = priority;
+    j.data.assign((const uint8_t*)data, (const uint8_t*)data + size);
+
+    return _submit(job);
+}
+
+std::future<EcMailboxResult> EthercatMailbox::_submit(std::list<_Job> &job)
+{
+    _Job &j = job.front();
+    j.sent = false;
+    j.start = std::chrono::steady_clock::now();
+    std::future<EcMailboxResult> future = j.promise.get_future();
+
+    std::list<_Job> garbage;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _incoming.splice(_incoming.end(), job);
+        garbage.swap(_garbage);
+    }
+    // Finished jobs are freed here, outside of the lock.
+
+    return future;
+}
+
+std::future<EcMailboxResult> EthercatMailbox::_failedFuture(const char *error, const std::string &message)
+{
+    errorMessage = message;
+
+    std::promise<EcMailboxResult> promise;
+    EcMailboxResult result;
+    result.error = error;
+    promise.set_value(std::move(result));
+    _failed.fetch_add(1, std::memory_order_relaxed);
+
+    return promise.get_future();
+}
+
+void EthercatMailbox::queue(void)
+{
+    // The frame of an earlier exchange of this cycle is still on the way, e.g. when the process data was resent.
+    if(_frameSent)
+    {
+        return;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    _passes++;
+    _datagramCount = 0;
+    _frameBytes = 0;
+
+    int slaves = ec_slavecount;
+    if(slaves < 1)
+    {
+        return;
+    }
+    if(slaves >= EC_MAXSLAVE)
+    {
+        slaves = EC_MAXSLAVE - 1;
+    }
+
+    bool budget_spent = false;
+
+    /*
+    Higher priorities first. Within a priority the slaves are served round-robin, starting one slave later
+    every pass, so a small budget still reaches every slave in turn.
+    */
+    for(int priority = 0; (priority < MBX_PRIORITY_NUM) && !budget_spent; priority++)
+    {
+        for(int k = 0; k < slaves; k++)
+        {
+            uint16 slave = (uint16)(1 + (_cursor + k) % slaves);
+            std::list<_Job> &active = _active[slave];
+            std::list<_Job> &queue = _queue[slave][priority];
+
+            if(active.empty())
+            {
+                if(queue.empty())
+                {
+                    continue;
+                }
+                active.splice(active.end(), queue, queue.begin());
+            }
+            else if(active.front().priority != priority)
+            {
+                continue;
+            }
+
+            // A blocking transfer uses the mailbox, its reply must not be read here. Try again next pass.
+            if(!_own(slave))
+            {
+                if(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - active.front().start).count() >= _timeoutUs)
+                {
+                    _finish(slave, false, 0, "mailbox of slave in use");
+                }
+                continue;
+            }
+
+            if(!_plan(slave, active.front().sent ? _READ_MAILBOX : _WRITE_MAILBOX, start))
+            {
+                budget_spent = true;
+                break;
+            }
+        }
+    }
+
+    // Idle slaves are checked for emergency messages with the budget that is left. Slaves with a job are read anyway.
+    if( (_emergency != nullptr) && !budget_spent )
+    {
+        for(int k = 0; k < slaves; k++)
+        {
+            uint16 slave = (uint16)(1 + (_cursor + k) % slaves);
+
+            // The EoE bridge reads the mailbox of EoE slaves itself, frames from the slave are not dropped here.
+            if( !_active[slave].empty() || ((ec_slave[slave].mbx_proto & ECT_MBXPROT_COE) == 0) ||
+                ((ec_slave[slave].mbx_proto & ECT_MBXPROT_EOE) != 0) )
+            {
+                continue;
+            }
+
+            // The status read of an earlier pass found a message, read it. Otherwise check the status in turn.
+            uint8_t type = _full[slave] ? _READ_IDLE : _READ_STATUS;
+            if( (type == _READ_STATUS) && (_passes - _lastIdlePoll[slave] < _emergencyPollPasses) )
+            {
+                continue;
+            }
+
+            // A message in a mailbox owned by a blocking transfer is its reply.
+            if( (type == _READ_IDLE) && !_own(slave) )
+            {
+                _full[slave] = false;
+                continue;
+            }
+
+            if(!_plan(slave, type, start))
+            {
+                if(type == _READ_IDLE)
+                {
+                    _owner[slave].unlock();
+                }
+                budget_spent = true;
+                break;
+            }
+
+            _full[slave] = false;
+            if(type == _READ_STATUS)
+            {
+                _lastIdlePoll[slave] = _passes;
+            }
+        }
+    }
+
+    _cursor = (_cursor + 1) % slaves;
+
+    if(budget_spent)
+    {
+        _budgetCycles.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    _sendFrame();
+
+    _queueUs = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void EthercatMailbox::service(uint64_t cycle, bool received)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    _cycle = cycle;
+
+    if(_frameSent)
+    {
+        // The receive of the process data stored the frame when it arrived.
+        int frame_wkc = received ? ec_waitinframe(_idx, EC_TIMEOUTRET) : EC_NOFRAME;
+        const uint8 *rx = ecx_context.port->rxbuf[_idx];
+
+        for(int i = 0; i < _datagramCount; i++)
+        {
+            const _Datagram &d = _datagrams[i];
+            int wkc = 0;
+            if(frame_wkc > EC_NOFRAME)
+            {
+                uint16 le_wkc;
+                memcpy(&le_wkc, rx + d.rxOffset + d.length, EC_WKCSIZE);
+                wkc = etohs(le_wkc);
+            }
+
+            // A mailbox write to a full mailbox and a read of an empty mailbox have working counter 0.
+            ec_mbxbuft mbx;
+            switch(d.type)
+            {
+            case _WRITE_MAILBOX:
+                _written(d.slave, wkc > 0, d.counter);
+                break;
+
+            case _READ_MAILBOX:
+            case _READ_IDLE:
+                ec_clearmbx(&mbx);
+                if(wkc > 0)
+                {
+                    memcpy(&mbx, rx + d.rxOffset, d.length);
+                }
+                if(d.type == _READ_MAILBOX)
+                {
+                    _received(d.slave, wkc > 0, mbx);
+                }
+                else
+                {
+                    // Nobody owned the mailbox, so any other message has no receiver and is dropped.
+                    _checkEmergency(d.slave, mbx);
+                    _owner[d.slave].unlock();
+                }
+                break;
+
+            case _READ_STATUS:
+                _full[d.slave] = (wkc > 0) && ((rx[d.rxOffset] & 0x08) != 0);
+                break;
+            }
+        }
+
+        ec_setbufstat(_idx, EC_BUF_EMPTY);
+        _frameSent = false;
+    }
+
+    // Take new jobs and hand back finished ones, but never wait for a submitting thread.
+    if(_mutex.try_lock())
+    {
+        while(!_incoming.empty())
+        {
+            _Job &j = _incoming.front();
+            std::list<_Job> &queue = _queue[j.slave][j.priority];
+            queue.splice(queue.end(), _incoming, _incoming.begin());
+        }
+        _garbage.splice(_garbage.end(), _finished);
+        _mutex.unlock();
+    }
+
+    uint32_t us = _queueUs + (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    _queueUs = 0;
+    if(us > _maxServiceUs.load(std::memory_order_relaxed))
+    {
+        _maxServiceUs.store(us, std::memory_order_relaxed);
+    }
+}
+
+EcMailboxStats EthercatMailbox::getStats(void)
+{
+    EcMailboxStats stats;
+    stats.completed = _completed.load(std::memory_order_relaxed);
+    stats.failed = _failed.load(std::memory_order_relaxed);
+    stats.budgetCycles = _budgetCycles.load(std::memory_order_relaxed);
+    stats.maxServiceUs = _maxServiceUs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool EthercatMailbox::_own(uint16 slave)
+{
+    if(!_owner[slave].owns_lock())
+    {
+        _owner[slave] = std::unique_lock<std::mutex>(EthercatWorkers::mailbox(slave), std::try_to_lock);
+    }
+    return _owner[slave].owns_lock();
+}
+
+bool EthercatMailbox::_plan(uint16 slave, uint8_t type, std::chrono::steady_clock::time_point start)
+{
+    uint16 length = ec_slave[slave].mbx_rl;
+    if(type == _WRITE_MAILBOX)
+    {
+        length = ec_slave[slave].mbx_l;
+    }
+    else if(type == _READ_STATUS)
+    {
+        length = 1;
+    }
+
+    // Datagram header, data and working counter.
+    uint32_t bytes = (EC_HEADERSIZE - EC_ELENGTHSIZE) + length + EC_WKCSIZE;
+
+    if( (_datagramCount >= _MAX_DATAGRAMS) || (_frameBytes + bytes > _FRAME_SIZE) || (_frameBytes >= _budgetBytes) ||
+        (std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() >= _budgetUs) )
+    {
+        return false;
+    }
+
+    _Datagram &d = _datagrams[_datagramCount++];
+    d.slave = slave;
+    d.type = type;
+    d.length = length;
+    _frameBytes += bytes;
+
+    return true;
+}
+
+void EthercatMailbox::_sendFrame(void)
+{
+    if(_datagramCount == 0)
+    {
+        return;
+    }
+
+    /*
+    ec_send_processdata() builds its frames inside SOEM, so the mailbox datagrams go in a frame of their own
+    right behind them. The receive of the process data stores it when it arrives, so it costs no extra round trip.
+    */
+    _idx = ec_getindex();
+    void *buffer = &ecx_context.port->txbuf[_idx];
+
+    for(int i = 0; i < _datagramCount; i++)
+    {
+        _Datagram &d = _datagrams[i];
+        const ec_slavet &s = ec_slave[d.slave];
+        uint8 command = EC_CMD_FPRD;
+        uint16 ado = s.mbx_ro;
+
+        ec_clearmbx(&_scratch);
+        if(d.type == _WRITE_MAILBOX)
+        {
+            command = EC_CMD_FPWR;
+            ado = s.mbx_wo;
+            d.counter = _buildRequest(d.slave, _scratch);
+        }
+        else if(d.type == _READ_STATUS)
+        {
+            ado = ECT_REG_SM1STAT;
+        }
+
+        if(i == 0)
+        {
+            ec_setupdatagram(buffer, command, _idx, s.configadr, ado, d.length, &_scratch);
+            d.rxOffset = EC_HEADERSIZE;
+        }
+        else
+        {
+            d.rxOffset = ec_adddatagram(buffer, command, _idx, (i + 1 < _datagramCount), s.configadr, ado, d.length, &_scratch);
+        }
+    }
+
+    ec_outframe_red(_idx);
+    _frameSent = true;
+}
+
+uint8 EthercatMailbox::_buildRequest(uint16 slave, ec_mbxbuft &mbx)
+{
+    _Job &j = _active[slave].front();
+    EcSdoFrame *sdo = (EcSdoFrame*)&mbx;
+
+    uint32_t size = (uint32_t)j.data.size();
+    uint8 cnt = ec_nextmbxcnt(ec_slave[slave].mbx_cnt);
+
+    sdo->header.address = htoes(0x0000);
+    sdo->header.priority = 0x00;
+    sdo->header.mbxtype = ECT_MBXT_COE + (cnt << 4);
+    sdo->canopen = htoes(0x000 + (ECT_COES_SDOREQ << 12));
+    sdo->index = htoes(j.index);
+    sdo->subindex = j.subindex;
+
+    if(!j.write)
+    {
+        sdo->header.length = htoes(0x000a);
+        sdo->command = ECT_SDO_UP_REQ;
+    }
+    else if(size <= 4)
+    {
+        // Expedited download, the number of unused bytes is in the command.
+        sdo->header.length = htoes(0x000a);
+        sdo->command = ECT_SDO_DOWN_EXP | (((4 - size) << 2) & 0x0c);
+        memcpy(sdo->data, j.data.data(), size);
+    }
+    else
+    {
+        sdo->header.length = htoes((uint16)(0x000a + size));
+        sdo->command = ECT_SDO_DOWN_INIT;
+        uint32 le_size = htoel(size);
+        memcpy(sdo->data, &le_size, 4);
+        memcpy(sdo->data + 4, j.data.data(), size);
+    }
+
+    return cnt;
+}
+
+void EthercatMailbox::_written(uint16 slave, bool ok, uint8 counter)
+{
+    _Job &j = _active[slave].front();
+
+    if(ok)
+    {
+        ec_slave[slave].mbx_cnt = counter;
+        j.sent = true;
+        return;
+    }
+
+    /*
+    The mailbox was full or the frame was lost, the request is written again next pass with the same counter.
+    Should the lost frame have reached the slave, the slave drops the repeated request.
+    */
+    if(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - j.start).count() >= _timeoutUs)
+    {
+        _finish(slave, false, 0, "mailbox of slave not empty");
+    }
+}
+
+void EthercatMailbox::_received(uint16 slave, bool ok, const ec_mbxbuft &mbx)
+{
+    _Job &j = _active[slave].front();
+
+    if( !ok || _checkEmergency(slave, mbx) )
+    {
+        if(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - j.start).count() >= _timeoutUs)
+        {
+            _finish(slave, false, 0, "no reply");
+        }
+        return;
+    }
+
+    const EcSdoFrame *sdo = (const EcSdoFrame*)&mbx;
+
+    if( (sdo->header.mbxtype & 0x0f) != ECT_MBXT_COE )
+    {
+        // Not for this scheduler, keep waiting.
+        return;
+    }
+
+    if(sdo->command == ECT_SDO_ABORT)
+    {
+        uint32 abort_code;
+        memcpy(&abort_code, sdo->data, 4);
+        _finish(slave, false, etohl(abort_code), "SDO abort");
+        return;
+    }
+
+    if( ((etohs(sdo->canopen) >> 12) != ECT_COES_SDORES) || (etohs(sdo->index) != j.index) || (sdo->subindex != j.subindex) )
+    {
+        return;
+    }
+
+    if(j.write)
+    {
+        _finish(slave, true, 0, nullptr);
+        return;
+    }
+
+    if(sdo->command & 0x02)
+    {
+        // Expedited upload, the number of unused bytes is in the command.
+        uint32_t size = 4 - ((sdo->command >> 2) & 0x03);
+        j.data.assign(sdo->data, sdo->data + size);
+        _finish(slave, true, 0, nullptr);
+        return;
+    }
+
+    uint32 le_size;
+    memcpy(&le_size, sdo->data, 4);
+    uint32_t size = etohl(le_size);
+    uint32_t available = (etohs(sdo->header.length) > 10) ? (uint32_t)etohs(sdo->header.length) - 10 : 0;
+
+    if( (size > available) || (size > j.data.capacity()) )
+    {
+        _finish(slave, false, 0, "segmented transfer not supported");
+        return;
+    }
+
+    j.data.assign(sdo->data + 4, sdo->data + 4 + size);
+    _finish(slave, true, 0, nullptr);
+}
+
+bool EthercatMailbox::_checkEmergency(uint16 slave, const ec_mbxbuft &mbx)
+{
+    // A cleared buffer has length zero.
+    const EcEmergencyFrame *frame = (const EcEmergencyFrame*)&mbx;
+
+    if( (etohs(frame->header.length) == 0) || ((frame->header.mbxtype & 0x0f) != ECT_MBXT_COE) ||
+        ((etohs(frame->canopen) >> 12) != ECT_COES_EMERGENCY) )
+    {
+        return false;
+    }
+
+    if(_emergency == nullptr)
+    {
+        return true;
+    }
+
+    EcEmergency emergency;
+    emergency.slave = slave;
+    emergency.errorCode = etohs(frame->errorCode);
+    emergency.errorRegister = frame->errorRegister;
+    emergency.data[0] = frame->data1;
+    memcpy(&emergency.data[1], &frame->data2, 2);
+    memcpy(&emergency.data[3], &frame->data3, 2);
+    emergency.cycle = _cycle;
+    emergency.timeNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    _emergency->push(emergency);
+
+    return true;
+}
+
+void EthercatMailbox::_finish(uint16 slave, bool ok, uint32_t abort_code, const char *error)
+{
+    _Job &j = _active[slave].front();
+
+    EcMailboxResult result;
+    result.ok = ok;
+    result.abortCode = abort_code;
+    result.error = error;
+    result.durationUs = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - j.start).count();
+    if(ok && !j.write)
+    {
+        result.data.swap(j.data);
+    }
+    j.promise.set_value(std::move(result));
+
+    if(ok)
+    {
+        _completed.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        _failed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    _finished.splice(_finished.end(), _active[slave]);
+
+    if(_owner[slave].owns_lock())
+    {
+        _owner[slave].unlock();
+    }
+}
@@ -0,0 +1,264 @@
+#ifndef _ETHERCATMAILBOX_H
+#define _ETHERCATMAILBOX_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include "ethercat.h"
+#include "EthercatEmergency.h"
+
+// ##################################################################################
+// Data structures:
+
+enum EcMailboxPriority : uint8_t
+{
+    MBX_PRIORITY_HIGH = 0,
+    MBX_PRIORITY_NORMAL,
+    MBX_PRIORITY_LOW,
+    MBX_PRIORITY_NUM
+};
+
+// Result of a scheduled SDO transfer.
+struct EcMailboxResult
+{
+    bool ok = false;
+
+    // SDO abort code of the slave, 0 if the transfer was not aborted by the slave.
+    uint32_t abortCode = 0;
+
+    // Data of a read.
+    std::vector<uint8_t> data;
+
+    // Time from the request until the result.
+    uint32_t durationUs = 0;
+
+    // Reason of a failure, nullptr if ok. Static text, so the cyclic thread does not allocate.
+    const char *error = nullptr;
+};
+
+// Counters of the mailbox scheduler.
+struct EcMailboxStats
+{
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+
+    // Cycles that ended the mailbox pass at the budget with work left.
+    uint64_t budgetCycles = 0;
+
+    // Longest mailbox pass in microseconds.
+    uint32_t maxServiceUs = 0;
+};
+
+// ###################################################################################
+// EthercatMailbox class:
+
+/**
+ * @brief Mailbox scheduler that runs SDO transfers in the cyclic thread, in a frame behind the process data frame.
+ * readSDO() and writeSDO() of SimpleEthercat block until the reply is there. Here each transfer is split in
+ * steps: write the request into the mailbox, and read the mailbox for the reply. Every cycle queue() puts the
+ * steps of one pass as datagrams into one frame right behind the process data frame, until the byte or time
+ * budget is spent, and service() takes their results after the exchange. The frame travels with the process
+ * data, so a pass costs no round trip of its own, only the frame length on the line (datagram header, mailbox
+ * size and working counter for each step). A write into a full mailbox and a read of an empty mailbox have
+ * working counter 0 and are repeated next pass, so a transfer takes at least two cycles.
+ * Slaves are served round-robin, higher priorities first, with one transfer in flight per slave.
+ * Expedited and normal transfers up to the mailbox size are supported, larger objects need segmented transfer
+ * with SimpleEthercat::readSDO().
+ * With an emergency queue attached, the SM1 status of idle CoE slaves is also read in turn, a full mailbox is
+ * read the next pass, and CoE emergency messages found in any mailbox read are decoded and queued.
+ * The scheduler owns the mailbox of a slave (EthercatWorkers::mailbox()) from the request until the reply. A slave
+ * whose mailbox is owned by a blocking transfer (SDO, object dictionary, FoE, EoE) is skipped until it is free,
+ * so neither side reads the reply of the other. Idle slaves with EoE are left to the EoE bridge.
+ * @note Attach with SimpleEthercat::setMailbox().
+ */
+class EthercatMailbox
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    /**
+     * @brief Schedule an SDO read. May be called from any thread.
+     * @return future of the result. A request that can not be scheduled has a result with ok false at once.
+     */
+    std::future<EcMailboxResult> read(uint16 slave, uint16 index, uint8 subindex, EcMailboxPriority priority = MBX_PRIORITY_NORMAL);
+
+    /**
+     * @brief Schedule an SDO write. May be called from any thread.
+     * @return future of the result. A request that can not be scheduled has a result with ok false at once.
+     */
+    std::future<EcMailboxResult> write(uint16 slave, uint16 index, uint8 subindex, const void *data, uint32_t size,
+                                       EcMailboxPriority priority = MBX_PRIORITY_NORMAL);
+
+    /**
+     * @brief Set budget of one mailbox pass. Default is 4096 bytes and 100 us.
+     * A pass stops at the first step after either budget is spent, so one step always runs. The frame of a 
+     * pass holds at most one Ethernet frame of datagrams.
+     */
+    void setBudget(uint32_t bytes_per_cycle, uint32_t us_per_cycle) {_budgetBytes = bytes_per_cycle; _budgetUs = us_per_cycle;}
+
+    // Set time after that a transfer without reply fails. Default is EC_TIMEOUTRXM.
+    void setTimeout(uint32_t timeout_us) {_timeoutUs = timeout_us;}
+
+    /**
+     * @brief Attach a queue for CoE emergency messages, nullptr to detach. Call before the cyclic thread starts.
+     * @param poll_passes is the number of passes between two reads of the mailbox of an idle slave.
+     */
+    void setEmergencyQueue(EthercatEmergency *queue, uint32_t poll_passes = 10) {_emergency = queue; _emergencyPollPasses = poll_passes;}
+
+    // Send the frame of one mailbox pass. Called by SimpleEthercat::updateProccess() right after the process data.
+    void queue(void);
+
+    /**
+     * @brief Take the results of the frame of queue() and new jobs. Called by SimpleEthercat::updateProccess() 
+     * after the exchange.
+     * @param cycle is the process data cycle, for the time stamp of emergency messages.
+     * @param received is false if the process data frame was lost, the mailbox frame is then not waited for.
+     */
+    void service(uint64_t cycle = 0, bool received = true);
+
+    // Return counters. May be called from any thread.
+    EcMailboxStats getStats(void);
+
+private:
+
+    struct _Job
+    {
+        uint16 slave;
+        uint16 index;
+        uint8 subindex;
+        bool write;
+        EcMailboxPriority priority;
+
+        // Request has been written to the mailbox of the slave.
+        bool sent;
+
+        // Data to write, or room for the data read.
+        std::vector<uint8_t> data;
+
+        std::promise<EcMailboxResult> promise;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // Step of a pass, one datagram in the mailbox frame.
+    enum : uint8_t
+    {
+        _WRITE_MAILBOX = 0,
+        _READ_MAILBOX,
+        _READ_IDLE,
+        _READ_STATUS
+    };
+
+    struct _Datagram
+    {
+        uint16 slave;
+        uint8_t type;
+        uint16 length;
+        uint16 rxOffset;
+
+        // Mailbox counter of a request.
+        uint8 counter;
+    };
+
+    // Room for datagrams in one Ethernet frame.
+    static const uint32_t _FRAME_SIZE = EC_MAXECATFRAME - ETH_HEADERSIZE - EC_ELENGTHSIZE - 4;
+
+    // Smallest datagram is a status read of 13 bytes.
+    static const int _MAX_DATAGRAMS = 128;
+
+    uint32_t _budgetBytes = 4096;
+    uint32_t _budgetUs = 100;
+    uint32_t _timeoutUs = EC_TIMEOUTRXM;
+
+    /*
+    Jobs are moved between lists with splice only, so the cyclic thread never allocates or frees memory.
+    New jobs are built by the submitting thread, finished jobs are freed by the next submitting thread.
+    */
+
+    // Protect _incoming and _garbage. The cyclic thread only uses try_lock.
+    std::mutex _mutex;
+    std::list<_Job> _incoming;
+    std::list<_Job> _garbage;
+
+    // Lists of the cyclic thread.
+    std::list<_Job> _queue[EC_MAXSLAVE][MBX_PRIORITY_NUM];
+    std::list<_Job> _active[EC_MAXSLAVE];
+    std::list<_Job> _finished;
+
+    // Slave number where the next pass starts.
+    int _cursor = 0;
+
+    EthercatEmergency *_emergency = nullptr;
+
+    uint32_t _emergencyPollPasses = 10;
+
+    uint64_t _passes = 0;
+
+    // Pass of the last read of the mailbox of each idle slave, index is slave number.
+    uint64_t _lastIdlePoll[EC_MAXSLAVE] = {};
+
+    // Cycle of the running pass.
+    uint64_t _cycle = 0;
+
+    // SM1 status read showed a message in the mailbox of the idle slave, index is slave number.
+    bool _full[EC_MAXSLAVE] = {};
+
+    // Mailbox owned by the scheduler, index is slave number. Only locked with try_lock.
+    std::unique_lock<std::mutex> _owner[EC_MAXSLAVE];
+
+    // Frame of the running pass.
+    _Datagram _datagrams[_MAX_DATAGRAMS];
+    int _datagramCount = 0;
+    uint32_t _frameBytes = 0;
+    uint8 _idx = 0;
+    bool _frameSent = false;
+
+    // Data of the datagram being added to the frame.
+    ec_mbxbuft _scratch;
+
+    // Time queue() took in the running pass.
+    uint32_t _queueUs = 0;
+
+    std::atomic<uint64_t> _completed{0};
+    std::atomic<uint64_t> _failed{0};
+    std::atomic<uint64_t> _budgetCycles{0};
+    std::atomic<uint32_t> _maxServiceUs{0};
+
+    std::future<EcMailboxResult> _submit(std::list<_Job> &job);
+
+    // Own the mailbox of the slave, if no blocking transfer uses it. Return true if owned.
+    bool _own(uint16 slave);
+
+    // Add a step to the frame of the pass. Return false if the budget is spent or the frame is full.
+    bool _plan(uint16 slave, uint8_t type, std::chrono::steady_clock::time_point start);
+
+    void _sendFrame(void);
+
+    // Build the request of the active job of the slave. Return its mailbox counter.
+    uint8 _buildRequest(uint16 slave, ec_mbxbuft &mbx);
+
+    // Result of the request write of the active job of the slave.
+    void _written(uint16 slave, bool ok, uint8 counter);
+
+    // Result of the mailbox read for the reply of the active job of the slave.
+    void _received(uint16 slave, bool ok, const ec_mbxbuft &mbx);
+
+    // Queue the mailbox content if it is a CoE emergency. Return true if it was one.
+    bool _checkEmergency(uint16 slave, const ec_mbxbuft &mbx);
+
+    void _finish(uint16 slave, bool ok, uint32_t abort_code, const char *error);
+
+    // Set errorMessage and return a future with a failed result.
+    std::future<EcMailboxResult> _failedFuture(const char *error, const std::string &message);
+};
+
+#endif
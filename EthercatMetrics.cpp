@@ -0,0 +1,372 @@
+#include "EthercatMetrics.h"
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+
+// ##################################################################################
+// EthercatMetrics class:
+
+const uint32_t EthercatMetrics::_CYCLE_BOUNDS_US[EthercatMetrics::_BUCKETS] =
+    {100, 250, 500, 750, 1000, 1250, 1500, 2000, 4000, 8000, 16000, 50000};
+
+const uint32_t EthercatMetrics::_SDO_BOUNDS_US[EthercatMetrics::_BUCKETS] =
+    {250, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000};
+
+EthercatMetrics::~EthercatMetrics()
+{
+    stop();
+}
+
+bool EthercatMetrics::start(const std::string &path, uint32_t period_ms)
+{
+    if(_thread.joinable())
+    {
+        errorMessage = "EthercatMetrics error: export thread is already running.";
+        return false;
+    }
+
+    if(period_ms == 0)
+    {
+        errorMessage = "EthercatMetrics error: export period must not be zero.";
+        return false;
+    }
+
+    // Check the path once here, the thread only keeps the last error.
+    if(!writeFile(path))
+    {
+        return false;
+    }
+
+    _threadStop = false;
+    _thread = std::thread([this, path, period_ms]()
+    {
+        std::unique_lock<std::mutex> lock(_threadMutex);
+        while(!_threadStop)
+        {
+            _threadCondition.wait_for(lock, std::chrono::milliseconds(period_ms));
+            lock.unlock();
+            writeFile(path);
+            lock.lock();
+        }
+    });
+
+    return true;
+}
+
+void EthercatMetrics::stop(void)
+{
+    if(!_thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_threadMutex);
+        _threadStop = true;
+    }
+    _threadCondition.notify_all();
+    _thread.join();
+}
+
+bool EthercatMetrics::writeFile(const std::string &path)
+{
+    std::string text = format();
+    std::string temp = path + ".tmp";
+
+    FILE *file = fopen(temp.c_str(), "w");
+    if(file == NULL)
+    {
+        _setError("EthercatMetrics error: can not open " + temp + ": " + strerror(errno));
+        return false;
+    }
+
+    bool ok = (fwrite(text.data(), 1, text.size(), file) == text.size());
+    ok &= (fclose(file) == 0);
+
+    // rename() replaces the old file in one step, the collector sees the old or the new file.
+    if( !ok || (rename(temp.c_str(), path.c_str()) != 0) )
+    {
+        _setError("EthercatMetrics error: can not write " + path + ": " + strerror(errno));
+        remove(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+std::string EthercatMetrics::format(void)
+{
+    static const char* const event_names[CYCLE_EVENT_NUM] = {"ok", "overrun", "frame_lost", "wkc_low", "skipped"};
+    static const char* const state_names[_STATES] = {"init", "pre_op", "safe_op", "op"};
+    static const char* const action_names[RECOVERY_ACTION_NUM] = {"ack", "to_op", "reconfig", "lost", "recovered", "found"};
+    static const char* const topology_names[TOPO_EVENT_NUM] = {"port_changed", "slave_recovered", "slave_changed",
+                                                               "slave_added", "slave_lost", "config_failed"};
+    static const char* const op_names[2] = {"read", "write"};
+
+    std::string out;
+    char line[160];
+    out.reserve(8192);
+
+    out += "# HELP ethercat_cycles_total Process data cycles, calls of updateProccess().\n";
+    out += "# TYPE ethercat_cycles_total counter\n";
+    snprintf(line, sizeof(line), "ethercat_cycles_total %llu\n", (unsigned long long)_cycles.load(std::memory_order_relaxed));
+    out += line;
+
+    out += "# HELP ethercat_cycle_events_total Classification of process data cycles.\n";
+    out += "# TYPE ethercat_cycle_events_total counter\n";
+    for(int i = 0; i < CYCLE_EVENT_NUM; i++)
+    {
+        snprintf(line, sizeof(line), "ethercat_cycle_events_total{event=\"%s\"} %llu\n", event_names[i],
+                 (unsigned long long)_cycleEvents[i].load(std::memory_order_relaxed));
+        out += line;
+    }
+
+    out += "# HELP ethercat_slave_cycle_errors_total Failed cycles in which the slave was found not operational or its datagram failed.\n";
+    out += "# TYPE ethercat_slave_cycle_errors_total counter\n";
+    int last = _slaves.load(std::memory_order_relaxed);
+    if(last < _maxErrorSlave.load(std::memory_order_relaxed))
+    {
+        last = _maxErrorSlave.load(std::memory_order_relaxed);
+    }
+    for(int slave = 1; (slave <= last) && (slave < EC_MAXSLAVE); slave++)
+    {
+        snprintf(line, sizeof(line), "ethercat_slave_cycle_errors_total{slave=\"%d\"} %llu\n", slave,
+                 (unsigned long long)_slaveCycleErrors[slave].load(std::memory_order_relaxed));
+        out += line;
+    }
+
+    out += "# HELP ethercat_state_transitions_total State requests of the master for all slaves.\n";
+    out += "# TYPE ethercat_state_transitions_total counter\n";
+    for(int i = 0; i < _STATES; i++)
+    {
+        for(int ok = 1; ok >= 0; ok--)
+        {
+            snprintf(line, sizeof(line), "ethercat_state_transitions_total{state=\"%s\",result=\"%s\"} %llu\n", state_names[i],
+                     ok ? "ok" : "failed", (unsigned long long)_stateTransitions[i][ok].load(std::memory_order_relaxed));
+            out += line;
+        }
+    }
+
+    out += "# HELP ethercat_recovery_actions_total Actions of the error check on single slaves.\n";
+    out += "# TYPE ethercat_recovery_actions_total counter\n";
+    for(int i = 0; i < RECOVERY_ACTION_NUM; i++)
+    {
+        snprintf(line, sizeof(line), "ethercat_recovery_actions_total{action=\"%s\"} %llu\n", action_names[i],
+                 (unsigned long long)_recoveries[i].load(std::memory_order_relaxed));
+        out += line;
+    }
+
+    out += "# HELP ethercat_topology_changes_total Changes of the line found by checkTopology().\n";
+    out += "# TYPE ethercat_topology_changes_total counter\n";
+    for(int i = 0; i < TOPO_EVENT_NUM; i++)
+    {
+        snprintf(line, sizeof(line), "ethercat_topology_changes_total{event=\"%s\"} %llu\n", topology_names[i],
+                 (unsigned long long)_topologyChanges[i].load(std::memory_order_relaxed));
+        out += line;
+    }
+
+    out += "# HELP ethercat_sdo_errors_total SDO transfers that failed.\n";
+    out += "# TYPE ethercat_sdo_errors_total counter\n";
+    for(int i = 0; i < 2; i++)
+    {
+        snprintf(line, sizeof(line), "ethercat_sdo_errors_total{op=\"%s\"} %llu\n", op_names[i],
+                 (unsigned long long)_sdoErrors[i].load(std::memory_order_relaxed));
+        out += line;
+    }
+
+    out += "# HELP ethercat_sdo_duration_seconds Duration of SDO transfers.\n";
+    out += "# TYPE ethercat_sdo_duration_seconds histogram\n";
+    _formatHistogram(out, "ethercat_sdo_duration_seconds", "op=\"read\"", _sdo[0], _SDO_BOUNDS_US);
+    _formatHistogram(out, "ethercat_sdo_duration_seconds", "op=\"write\"", _sdo[1], _SDO_BOUNDS_US);
+
+    out += "# HELP ethercat_cycle_interval_seconds Time between two updateProccess() calls.\n";
+    out += "# TYPE ethercat_cycle_interval_seconds histogram\n";
+    _formatHistogram(out, "ethercat_cycle_interval_seconds", "", _cycleInterval, _CYCLE_BOUNDS_US);
+
+    out += "# HELP ethercat_exchange_seconds Time of send and receive of process data.\n";
+    out += "# TYPE ethercat_exchange_seconds histogram\n";
+    _formatHistogram(out, "ethercat_exchange_seconds", "", _exchange, _CYCLE_BOUNDS_US);
+
+    out += "# HELP ethercat_slaves Number of slaves known to the master.\n";
+    out += "# TYPE ethercat_slaves gauge\n";
+    snprintf(line, sizeof(line), "ethercat_slaves %d\n", _slaves.load(std::memory_order_relaxed));
+    out += line;
+
+    out += "# HELP ethercat_wkc Working counter of the last cycle.\n";
+    out += "# TYPE ethercat_wkc gauge\n";
+    snprintf(line, sizeof(line), "ethercat_wkc %d\n", _wkc.load(std::memory_order_relaxed));
+    out += line;
+
+    out += "# HELP ethercat_expected_wkc Expected working counter.\n";
+    out += "# TYPE ethercat_expected_wkc gauge\n";
+    snprintf(line, sizeof(line), "ethercat_expected_wkc %d\n", _expectedWkc.load(std::memory_order_relaxed));
+    out += line;
+
+    return out;
+}
+
+void EthercatMetrics::reset(void)
+{
+    _cycles.store(0, std::memory_order_relaxed);
+    _resetCounters(_cycleEvents, CYCLE_EVENT_NUM);
+    _resetCounters(_slaveCycleErrors, EC_MAXSLAVE);
+    _resetCounters(&_stateTransitions[0][0], _STATES * 2);
+    _resetCounters(_recoveries, RECOVERY_ACTION_NUM);
+    _resetCounters(_topologyChanges, TOPO_EVENT_NUM);
+    _resetCounters(_sdoErrors, 2);
+
+    for(_Histogram *histogram : {&_cycleInterval, &_exchange, &_sdo[0], &_sdo[1]})
+    {
+        _resetCounters(histogram->buckets, _BUCKETS + 1);
+        histogram->sumUs.store(0, std::memory_order_relaxed);
+    }
+
+    _maxErrorSlave.store(0, std::memory_order_relaxed);
+}
+
+void EthercatMetrics::countCycle(EcCycleEvent event, uint32_t interval_us, uint32_t exchange_us, int wkc, int expected_wkc)
+{
+    _cycles.fetch_add(1, std::memory_order_relaxed);
+
+    if(event < CYCLE_EVENT_NUM)
+    {
+        _cycleEvents[event].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if(interval_us > 0)
+    {
+        _observe(_cycleInterval, _CYCLE_BOUNDS_US, interval_us);
+    }
+
+    if(event != CYCLE_SKIPPED)
+    {
+        _observe(_exchange, _CYCLE_BOUNDS_US, exchange_us);
+        _wkc.store(wkc, std::memory_order_relaxed);
+    }
+
+    _expectedWkc.store(expected_wkc, std::memory_order_relaxed);
+}
+
+void EthercatMetrics::countSlaveCycleError(uint16_t slave)
+{
+    if(slave >= EC_MAXSLAVE)
+    {
+        return;
+    }
+
+    _slaveCycleErrors[slave].fetch_add(1, std::memory_order_relaxed);
+
+    uint16_t max = _maxErrorSlave.load(std::memory_order_relaxed);
+    while( (slave > max) && !_maxErrorSlave.compare_exchange_weak(max, slave, std::memory_order_relaxed) )
+    {
+    }
+}
+
+void EthercatMetrics::countStateTransition(uint16_t state, bool ok)
+{
+    int index = _stateIndex(state);
+
+    if(index >= 0)
+    {
+        _stateTransitions[index][ok ? 1 : 0].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void EthercatMetrics::countRecovery(EcRecoveryAction action)
+{
+    if(action < RECOVERY_ACTION_NUM)
+    {
+        _recoveries[action].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void EthercatMetrics::countTopologyChange(EcTopologyEvent event)
+{
+    if(event < TOPO_EVENT_NUM)
+    {
+        _topologyChanges[event].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void EthercatMetrics::observeSdo(bool write, uint32_t duration_us, bool ok)
+{
+    _observe(_sdo[write ? 1 : 0], _SDO_BOUNDS_US, duration_us);
+
+    if(!ok)
+    {
+        _sdoErrors[write ? 1 : 0].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void EthercatMetrics::_setError(const std::string &message)
+{
+    std::lock_guard<std::mutex> lock(_errorMutex);
+    errorMessage = message;
+}
+
+void EthercatMetrics::_resetCounters(std::atomic<uint64_t> *counters, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        counters[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void EthercatMetrics::_observe(_Histogram &histogram, const uint32_t *bounds, uint32_t value_us)
+{
+    int i = 0;
+    while( (i < _BUCKETS) && (value_us > bounds[i]) )
+    {
+        i++;
+    }
+
+    histogram.buckets[i].fetch_add(1, std::memory_order_relaxed);
+    histogram.sumUs.fetch_add(value_us, std::memory_order_relaxed);
+}
+
+void EthercatMetrics::_formatHistogram(std::string &out, const char *name, const char *labels, const _Histogram &histogram, const uint32_t *bounds)
+{
+    const char *separator = (labels[0] != '\0') ? "," : "";
+    char line[200];
+    uint64_t count = 0;
+
+    // Prometheus buckets are cumulative.
+    for(int i = 0; i <= _BUCKETS; i++)
+    {
+        count += histogram.buckets[i].load(std::memory_order_relaxed);
+        if(i < _BUCKETS)
+        {
+            snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, separator, bounds[i] * 1e-6, (unsigned long long)count);
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, separator, (unsigned long long)count);
+        }
+        out += line;
+    }
+
+    const char *open = (labels[0] != '\0') ? "{" : "";
+    const char *close = (labels[0] != '\0') ? "}" : "";
+
+    snprintf(line, sizeof(line), "%s_sum%s%s%s %.6f\n", name, open, labels, close, histogram.sumUs.load(std::memory_order_relaxed) * 1e-6);
+    out += line;
+    snprintf(line, sizeof(line), "%s_count%s%s%s %llu\n", name, open, labels, close, (unsigned long long)count);
+    out += line;
+}
+
+int EthercatMetrics::_stateIndex(uint16_t state)
+{
+    switch(state)
+    {
+        case EC_STATE_INIT:
+            return 0;
+        case EC_STATE_PRE_OP:
+            return 1;
+        case EC_STATE_SAFE_OP:
+            return 2;
+        case EC_STATE_OPERATIONAL:
+            return 3;
+        default:
+            return -1;
+    }
+}
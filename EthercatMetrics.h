@@ -0,0 +1,149 @@
+#ifndef _ETHERCATMETRICS_H
+#define _ETHERCATMETRICS_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "SimpleEthercat.h"
+
+// ###################################################################################
+// EthercatMetrics class:
+
+/**
+ * @brief Metrics registry of a SimpleEthercat master with export in Prometheus text format.
+ * The master updates the metrics through lock-free atomic counters only, so the cyclic thread never
+ * blocks on the registry. A background thread writes all metrics periodically to a file for the textfile
+ * collector of node-exporter. The file is written under a temporary name and renamed, so the collector
+ * never reads a half written file.
+ *
+ * Exported metrics, all names start with ethercat_:
+ *      cycles_total, cycle_events_total{event}, slave_cycle_errors_total{slave},
+ *      state_transitions_total{state,result}, recovery_actions_total{action}, topology_changes_total{event},
+ *      sdo_duration_seconds{op} and sdo_errors_total{op}, cycle_interval_seconds and exchange_seconds histograms,
+ *      gauges slaves, wkc and expected_wkc.
+ * @note Attach with SimpleEthercat::setMetrics() before the cyclic thread starts.
+ */
+class EthercatMetrics
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    ~EthercatMetrics();
+
+    /**
+     * @brief Start the thread that writes the metrics file every period_ms.
+     * @return true if successed.
+     */
+    bool start(const std::string &path, uint32_t period_ms = 10000);
+
+    // Stop the export thread. The file is written once more.
+    void stop(void);
+
+    /**
+     * @brief Write the metrics file now, atomically by rename.
+     * @return true if successed.
+     */
+    bool writeFile(const std::string &path);
+
+    // Return all metrics in Prometheus text exposition format.
+    std::string format(void);
+
+    // Reset all counters and histograms.
+    void reset(void);
+
+    /*
+    Functions below are called by SimpleEthercat. They are lock-free and may be called from the cyclic thread.
+    */
+
+    /**
+     * @brief Count one updateProccess() call.
+     * @param interval_us is the time since the previous call, zero if not known.
+     * @param exchange_us is the time of send and receive, zero for a skipped cycle.
+     */
+    void countCycle(EcCycleEvent event, uint32_t interval_us, uint32_t exchange_us, int wkc, int expected_wkc);
+
+    // Count a failed cycle of a slave.
+    void countSlaveCycleError(uint16_t slave);
+
+    // Count a state request of the master for all slaves. state is EC_STATE_INIT .. EC_STATE_OPERATIONAL.
+    void countStateTransition(uint16_t state, bool ok);
+
+    void countRecovery(EcRecoveryAction action);
+
+    void countTopologyChange(EcTopologyEvent event);
+
+    // Record duration of one SDO transfer.
+    void observeSdo(bool write, uint32_t duration_us, bool ok);
+
+    void setSlaveCount(int count) {_slaves.store(count, std::memory_order_relaxed);}
+
+private:
+
+    // Number of histogram buckets without the +Inf bucket.
+    static const int _BUCKETS = 12;
+
+    // Upper bounds of the buckets in microseconds.
+    static const uint32_t _CYCLE_BOUNDS_US[_BUCKETS];
+    static const uint32_t _SDO_BOUNDS_US[_BUCKETS];
+
+    struct _Histogram
+    {
+        // Observations per bucket, not cumulative. Last one is +Inf.
+        std::atomic<uint64_t> buckets[_BUCKETS + 1];
+        std::atomic<uint64_t> sumUs;
+    };
+
+    // Index of the state counters, see _stateIndex().
+    static const int _STATES = 4;
+
+    std::atomic<uint64_t> _cycles{0};
+    std::atomic<uint64_t> _cycleEvents[CYCLE_EVENT_NUM] = {};
+    std::atomic<uint64_t> _slaveCycleErrors[EC_MAXSLAVE] = {};
+
+    // [state][0 = failed, 1 = ok]
+    std::atomic<uint64_t> _stateTransitions[_STATES][2] = {};
+    std::atomic<uint64_t> _recoveries[RECOVERY_ACTION_NUM] = {};
+    std::atomic<uint64_t> _topologyChanges[TOPO_EVENT_NUM] = {};
+    std::atomic<uint64_t> _sdoErrors[2] = {};
+
+    _Histogram _cycleInterval = {};
+    _Histogram _exchange = {};
+    // [0 = read, 1 = write]
+    _Histogram _sdo[2] = {};
+
+    std::atomic<int> _slaves{0};
+    std::atomic<int> _wkc{0};
+    std::atomic<int> _expectedWkc{0};
+
+    // Highest slave number that had a cycle error, only these are exported.
+    std::atomic<uint16_t> _maxErrorSlave{0};
+
+    std::thread _thread;
+    std::mutex _threadMutex;
+    std::condition_variable _threadCondition;
+    bool _threadStop = false;
+
+    // Protect errorMessage, the export thread may set it.
+    std::mutex _errorMutex;
+
+    void _setError(const std::string &message);
+
+    static void _resetCounters(std::atomic<uint64_t> *counters, size_t count);
+
+    static void _observe(_Histogram &histogram, const uint32_t *bounds, uint32_t value_us);
+
+    static void _formatHistogram(std::string &out, const char *name, const char *labels, const _Histogram &histogram, const uint32_t *bounds);
+
+    // Return index into _stateTransitions, -1 for other states.
+    static int _stateIndex(uint16_t state);
+};
+
+#endif
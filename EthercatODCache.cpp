@@ -0,0 +1,387 @@
+#include "EthercatODCache.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include "EthercatWorkers.h"
+
+// ##################################################################################
+// EthercatODCache class:
+
+void EthercatODCache::setCacheDirectory(const std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _directory = dir;
+
+    // Let every dictionary look into the new directory.
+    for(auto &item : _dictionaries)
+    {
+        item.second.fileChecked = false;
+    }
+}
+
+const EcODObject* EthercatODCache::getObject(uint16_t slave_id, uint16_t index)
+{
+    if( (slave_id < 1) || (slave_id > ec_slavecount) )
+    {
+        _setError("EthercatODCache error: slave id is out of range.");
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _Dictionary &dict = _getDictionary(slave_id);
+        auto it = dict.objects.find(index);
+        if(it != dict.objects.end())
+        {
+            return it->second.exists ? &it->second : nullptr;
+        }
+    }
+
+    // Not cached. Read it without holding the lock, so other slaves are not blocked.
+    EcODObject object;
+    if(!_readObject(slave_id, index, object))
+    {
+        // No answer or a busy mailbox says nothing about the object, ask again next time.
+        char str[80];
+        snprintf(str, sizeof(str), "EthercatODCache error: Failed to read object 0x%4.4x of slave %u.", index, slave_id);
+        _setError(str);
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _Dictionary &dict = _getDictionary(slave_id);
+    // std::map keeps element addresses, a parallel reader may have inserted the same object meanwhile.
+    auto result = dict.objects.emplace(index, std::move(object));
+    const EcODObject &cached = result.first->second;
+
+    if(!cached.exists)
+    {
+        _setError("EthercatODCache error: object is not in the dictionary of the slave.");
+        return nullptr;
+    }
+
+    return &cached;
+}
+
+const EcODEntry* EthercatODCache::getEntry(uint16_t slave_id, uint16_t index, uint8_t subindex)
+{
+    const EcODObject *object = getObject(slave_id, index);
+
+    if(object == nullptr)
+    {
+        return nullptr;
+    }
+
+    for(const EcODEntry &entry : object->entries)
+    {
+        if(entry.subindex == subindex)
+        {
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+int EthercatODCache::getEntrySize(uint16_t slave_id, uint16_t index, uint8_t subindex)
+{
+    const EcODEntry *entry = getEntry(slave_id, index, subindex);
+
+    if(entry == nullptr)
+    {
+        return -1;
+    }
+
+    return (entry->bitLength + 7) / 8;
+}
+
+std::vector<uint16_t> EthercatODCache::getObjectList(uint16_t slave_id)
+{
+    if( (slave_id < 1) || (slave_id > ec_slavecount) )
+    {
+        _setError("EthercatODCache error: slave id is out of range.");
+        return std::vector<uint16_t>();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _Dictionary &dict = _getDictionary(slave_id);
+        if(dict.listLoaded)
+        {
+            return dict.list;
+        }
+    }
+
+    // ec_ODlistt is about 48 kB, keep it off the stack.
+    std::unique_ptr<ec_ODlistt> odlist(new ec_ODlistt);
+    memset(odlist.get(), 0, sizeof(ec_ODlistt));
+
+    int wkc;
+    {
+        std::lock_guard<std::mutex> mailbox(EthercatWorkers::mailbox(slave_id));
+        wkc = ecx_readODlist(EthercatWorkers::context(), slave_id, odlist.get());
+    }
+
+    if(wkc <= 0)
+    {
+        _setError("EthercatODCache error: Failed to read object list of slave " + std::to_string(slave_id) + ".");
+        return std::vector<uint16_t>();
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _Dictionary &dict = _getDictionary(slave_id);
+    dict.list.assign(odlist->Index, odlist->Index + odlist->Entries);
+    dict.listLoaded = true;
+
+    return dict.list;
+}
+
+bool EthercatODCache::loadAll(uint16_t slave_id)
+{
+    std::vector<uint16_t> list = getObjectList(slave_id);
+
+    if(list.empty())
+    {
+        return false;
+    }
+
+    for(uint16_t index : list)
+    {
+        getObject(slave_id, index);
+    }
+
+    return true;
+}
+
+bool EthercatODCache::save(uint16_t slave_id)
+{
+    if( (slave_id < 1) || (slave_id > ec_slavecount) )
+    {
+        _setError("EthercatODCache error: slave id is out of range.");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _Identity id(ec_slave[slave_id].eep_man, ec_slave[slave_id].eep_id, ec_slave[slave_id].eep_rev);
+
+    return _saveFile(id, _getDictionary(slave_id));
+}
+
+bool EthercatODCache::saveAll(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    bool flag = true;
+
+    for(auto &item : _dictionaries)
+    {
+        flag &= _saveFile(item.first, item.second);
+    }
+
+    return flag;
+}
+
+void EthercatODCache::clear(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _dictionaries.clear();
+}
+
+EthercatODCache::_Dictionary& EthercatODCache::_getDictionary(uint16_t slave_id)
+{
+    _Identity id(ec_slave[slave_id].eep_man, ec_slave[slave_id].eep_id, ec_slave[slave_id].eep_rev);
+    _Dictionary &dict = _dictionaries[id];
+
+    if( !dict.fileChecked && !_directory.empty() )
+    {
+        dict.fileChecked = true;
+        _loadFile(id, dict);
+    }
+
+    return dict;
+}
+
+std::string EthercatODCache::_fileName(const _Identity &id)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/od_%8.8x_%8.8x_%8.8x.txt", std::get<0>(id), std::get<1>(id), std::get<2>(id));
+    return _directory + name;
+}
+
+void EthercatODCache::_setError(const std::string &message)
+{
+    std::lock_guard<std::mutex> lock(_errorMutex);
+    errorMessage = message;
+}
+
+bool EthercatODCache::_readObject(uint16_t slave_id, uint16_t index, EcODObject &object)
+{
+    std::unique_ptr<ec_ODlistt> odlist(new ec_ODlistt);
+    std::unique_ptr<ec_OElistt> oelist(new ec_OElistt);
+
+    // Own error list, it tells an abort of the slave from a timeout.
+    EthercatWorkers::Context context;
+
+    object.index = index;
+    object.dataType = 0;
+    object.objectCode = 0;
+    object.maxSub = 0;
+    object.exists = false;
+
+    /*
+    ec_readODdescription() and ec_readOE() work on an item of an object list. A list with the one
+    requested index is enough, so the full list of the slave is never read here.
+    */
+    memset(odlist.get(), 0, sizeof(ec_ODlistt));
+    odlist->Slave = slave_id;
+    odlist->Entries = 1;
+    odlist->Index[0] = index;
+
+    std::lock_guard<std::mutex> mailbox(EthercatWorkers::mailbox(slave_id));
+
+    if(ecx_readODdescription(context.get(), 0, odlist.get()) <= 0)
+    {
+        // Only an SDO information error means the slave does not have the object.
+        return context.popError(EC_ERR_TYPE_SDOINFO_ERROR, slave_id, index);
+    }
+
+    object.dataType = odlist->DataType[0];
+    object.objectCode = odlist->ObjectCode[0];
+    object.maxSub = odlist->MaxSub[0];
+    object.name = odlist->Name[0];
+    object.exists = true;
+
+    memset(oelist.get(), 0, sizeof(ec_OElistt));
+    if(ecx_readOE(context.get(), 0, odlist.get(), oelist.get()) <= 0)
+    {
+        // An object whose entries the slave refuses to describe is kept without entries.
+        return context.popError(EC_ERR_TYPE_SDOINFO_ERROR, slave_id, index);
+    }
+
+    for(int j = 0; (j <= object.maxSub) && (j < EC_MAXOELIST); j++)
+    {
+        if( (oelist->DataType[j] > 0) && (oelist->BitLength[j] > 0) )
+        {
+            object.entries.push_back({(uint8_t)j, oelist->DataType[j], oelist->BitLength[j], oelist->ObjAccess[j], oelist->Name[j]});
+        }
+    }
+
+    return true;
+}
+
+/*
+Dictionary file format, one record per line, numbers in hex, name is the rest of the line:
+O <index> <data type> <object code> <max sub> <exists> <name>
+E <subindex> <data type> <bit length> <access> <name>
+L <index>
+E lines belong to the last O line. L lines hold the object list in slave order.
+*/
+
+bool EthercatODCache::_loadFile(const _Identity &id, _Dictionary &dict)
+{
+    FILE *file = fopen(_fileName(id).c_str(), "r");
+
+    if(file == NULL)
+    {
+        return false;
+    }
+
+    char line[256];
+    EcODObject *object = nullptr;
+    std::vector<uint16_t> list;
+
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        unsigned int a, b, c, d, e;
+        char name[EC_MAXNAME + 1] = {0};
+
+        if(sscanf(line, "O %x %x %x %x %x %40[^\n]", &a, &b, &c, &d, &e, name) >= 5)
+        {
+            // Objects cached already stay as they are, other threads may hold pointers to them.
+            auto inserted = dict.objects.emplace((uint16_t)a, EcODObject());
+            if(!inserted.second)
+            {
+                object = nullptr;
+                continue;
+            }
+
+            EcODObject &item = inserted.first->second;
+            item.index = (uint16_t)a;
+            item.dataType = (uint16_t)b;
+            item.objectCode = (uint8_t)c;
+            item.maxSub = (uint8_t)d;
+            item.exists = (e != 0);
+            item.name = name;
+            object = &item;
+        }
+        else if( (object != nullptr) && (sscanf(line, "E %x %x %x %x %40[^\n]", &a, &b, &c, &d, name) >= 4) )
+        {
+            object->entries.push_back({(uint8_t)a, (uint16_t)b, (uint16_t)c, (uint16_t)d, name});
+        }
+        else if(sscanf(line, "L %x", &a) == 1)
+        {
+            list.push_back((uint16_t)a);
+        }
+    }
+
+    fclose(file);
+
+    // A list read before is kept, like the objects.
+    if( !list.empty() && !dict.listLoaded )
+    {
+        dict.list = std::move(list);
+        dict.listLoaded = true;
+    }
+
+    return true;
+}
+
+bool EthercatODCache::_saveFile(const _Identity &id, _Dictionary &dict)
+{
+    if(_directory.empty())
+    {
+        _setError("EthercatODCache error: No cache directory set.");
+        return false;
+    }
+
+    // Write a temporary file and rename it, so a reader never sees a half written dictionary.
+    std::string name = _fileName(id);
+    std::string temp = name + ".tmp";
+    FILE *file = fopen(temp.c_str(), "w");
+
+    if(file == NULL)
+    {
+        _setError("EthercatODCache error: Can not write " + temp + ".");
+        return false;
+    }
+
+    for(const auto &item : dict.objects)
+    {
+        const EcODObject &object = item.second;
+        fprintf(file, "O %4.4x %4.4x %2.2x %2.2x %x %s\n", object.index, object.dataType, object.objectCode,
+                object.maxSub, object.exists ? 1 : 0, object.name.c_str());
+        for(const EcODEntry &entry : object.entries)
+        {
+            fprintf(file, "E %2.2x %4.4x %4.4x %4.4x %s\n", entry.subindex, entry.dataType, entry.bitLength,
+                    entry.access, entry.name.c_str());
+        }
+    }
+
+    if(dict.listLoaded)
+    {
+        for(uint16_t index : dict.list)
+        {
+            fprintf(file, "L %4.4x\n", index);
+        }
+    }
+
+    if( (fclose(file) != 0) || (rename(temp.c_str(), name.c_str()) != 0) )
+    {
+        _setError("EthercatODCache error: Can not write " + name + ".");
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,175 @@
+#ifndef _ETHERCATODCACHE_H
+#define _ETHERCATODCACHE_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include "ethercat.h"
+
+// ##################################################################################
+// Data structures:
+
+// Description of one subindex of an object dictionary object.
+struct EcODEntry
+{
+    uint8_t subindex;
+
+    // CoE data type (ECT_UNSIGNED16, ECT_REAL32, ...).
+    uint16_t dataType;
+
+    uint16_t bitLength;
+
+    // Access flags as reported by the slave (bit 0..5 = read/write in PRE_OP, SAFE_OP, OP).
+    uint16_t access;
+
+    std::string name;
+};
+
+// Description of one object dictionary object.
+struct EcODObject
+{
+    uint16_t index;
+
+    uint16_t dataType;
+
+    // Object code: 0x07 VAR, 0x08 ARRAY, 0x09 RECORD.
+    uint8_t objectCode;
+
+    uint8_t maxSub;
+
+    // False if the slave does not have this object.
+    bool exists;
+
+    std::string name;
+
+    // Subindex entries that exist, sorted by subindex.
+    std::vector<EcODEntry> entries;
+};
+
+// ###################################################################################
+// EthercatODCache class:
+
+/**
+ * @brief Cache of CoE object dictionary descriptions.
+ * Descriptions are read from a slave on first access, one object at a time, instead of walking the
+ * whole dictionary. Slaves with the same vendor id, product code and revision share one dictionary,
+ * so identical drives are only asked once. Dictionaries can be stored in a directory and are loaded
+ * from there on first access, after that type and size queries need no bus traffic at all.
+ * Objects are never changed or removed once cached, except by clear(). A file loaded after setCacheDirectory()
+ * only adds objects that are not cached yet.
+ * @note The methods may be called from several threads, bus reads for different slaves run in parallel.
+ * Returned pointers stay valid until clear(), which must not run while another thread uses the cache.
+ */
+class EthercatODCache
+{
+public:
+
+    // Last error message accured for object. Read it only while no other thread uses the cache.
+    std::string errorMessage;
+
+    /**
+     * @brief Set directory for dictionary files. Empty string disables disk storage (default).
+     * Files are named od_<vendor>_<product>_<revision>.txt. Their objects are added to the objects cached already.
+     */
+    void setCacheDirectory(const std::string &dir);
+
+    /**
+     * @brief Return description of an object. Read it from the slave if it is not cached yet.
+     * An object the slave does not have is cached as missing. A read that timed out is not cached and tried again.
+     * @return nullptr if the slave has no such object or it could not be read.
+     */
+    const EcODObject* getObject(uint16_t slave_id, uint16_t index);
+
+    /**
+     * @brief Return description of one subindex. Read it from the slave if it is not cached yet.
+     * @return nullptr if the entry does not exist.
+     */
+    const EcODEntry* getEntry(uint16_t slave_id, uint16_t index, uint8_t subindex);
+
+    /**
+     * @brief Return size of an entry in bytes (bit length rounded up).
+     * @return -1 if the entry does not exist.
+     */
+    int getEntrySize(uint16_t slave_id, uint16_t index, uint8_t subindex);
+
+    /**
+     * @brief Read the complete object list of a slave and describe every object.
+     * @return true if successed.
+     */
+    bool loadAll(uint16_t slave_id);
+
+    /**
+     * @brief Return indices of all objects of a slave, in the order the slave reports them.
+     * Reads the object list from the slave if it is not cached yet. Objects are not described by this call.
+     */
+    std::vector<uint16_t> getObjectList(uint16_t slave_id);
+
+    /**
+     * @brief Write the dictionary of the slave identity into the cache directory.
+     * @return true if successed.
+     */
+    bool save(uint16_t slave_id);
+
+    /**
+     * @brief Write all cached dictionaries into the cache directory.
+     * @return true if successed.
+     */
+    bool saveAll(void);
+
+    // Forget all cached dictionaries. Pointers returned before become invalid.
+    void clear(void);
+
+private:
+
+    // Vendor id, product code and revision.
+    typedef std::tuple<uint32_t, uint32_t, uint32_t> _Identity;
+
+    struct _Dictionary
+    {
+        std::map<uint16_t, EcODObject> objects;
+
+        // Object indices in slave order, filled by getObjectList().
+        std::vector<uint16_t> list;
+
+        bool listLoaded = false;
+
+        // Indicate the dictionary file has already been tried.
+        bool fileChecked = false;
+    };
+
+    std::map<_Identity, _Dictionary> _dictionaries;
+
+    std::string _directory;
+
+    std::mutex _mutex;
+
+    // Protect errorMessage, it is written by parallel readers.
+    std::mutex _errorMutex;
+
+    void _setError(const std::string &message);
+
+    // Return the dictionary of the slave identity, load it from disk on first use. Call with _mutex locked.
+    _Dictionary& _getDictionary(uint16_t slave_id);
+
+    // Return the file name for a slave identity.
+    std::string _fileName(const _Identity &id);
+
+    /*
+    Read description and entries of one object from the slave. No locking, touches only the bus.
+    Return false if the slave did not answer. object is then not to be cached, only an abort of the slave 
+    says the object does not exist.
+    */
+    static bool _readObject(uint16_t slave_id, uint16_t index, EcODObject &object);
+
+    bool _loadFile(const _Identity &id, _Dictionary &dict);
+
+    bool _saveFile(const _Identity &id, _Dictionary &dict);
+};
+
+#endif
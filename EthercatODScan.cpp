@@ -0,0 +1,577 @@
+#include "EthercatODScan.h"
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cinttypes>
+#include <thread>
+#include <tuple>
+#include <algorithm>
+#include <memory>
+#include "EthercatWorkers.h"
+
+// ##################################################################################
+// EthercatODScan class:
+
+bool EthercatODScan::scan(const std::vector<uint16_t> &slaves, bool values)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    _results.clear();
+
+    if(_ethercat.getSlaveCount() < 1)
+    {
+        errorMessage = "EthercatODScan error: no slaves found, call configSlaves() first.";
+        return false;
+    }
+
+    std::vector<uint16_t> list = slaves;
+    if(list.empty())
+    {
+        for(uint16_t slave = 1; slave <= _ethercat.getSlaveCount(); slave++)
+        {
+            if(ec_slave[slave].mbx_proto & ECT_MBXPROT_COE)
+            {
+                list.push_back(slave);
+            }
+        }
+    }
+
+    for(uint16_t slave : list)
+    {
+        EcSlaveDictionary result;
+        result.slave = slave;
+        result.ok = true;
+        result.durationUs = 0;
+
+        if( (slave < 1) || (slave > _ethercat.getSlaveCount()) )
+        {
+            result.ok = false;
+            result.error = "slave is not on the bus";
+        }
+        else if(!(ec_slave[slave].mbx_proto & ECT_MBXPROT_COE))
+        {
+            result.ok = false;
+            result.error = "slave has no CoE mailbox";
+        }
+
+        _results.push_back(std::move(result));
+    }
+
+    _describe(start);
+
+    if(values)
+    {
+        _readValues(start);
+    }
+
+    int failed = 0;
+    for(const EcSlaveDictionary &result : _results)
+    {
+        if(!result.ok)
+        {
+            failed++;
+        }
+    }
+
+    if(failed > 0)
+    {
+        errorMessage = "EthercatODScan error: " + std::to_string(failed) + " slaves failed, see getResults().";
+        return false;
+    }
+
+    return true;
+}
+
+void EthercatODScan::_describe(std::chrono::steady_clock::time_point start)
+{
+    EthercatODCache &cache = _ethercat.getODCache();
+
+    // Results of slaves with the same vendor id, product code and revision, they share one dictionary.
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t>, std::vector<size_t>> identities;
+
+    for(size_t i = 0; i < _results.size(); i++)
+    {
+        if(_results[i].ok)
+        {
+            uint16_t slave = _results[i].slave;
+            identities[std::make_tuple(ec_slave[slave].eep_man, ec_slave[slave].eep_id, ec_slave[slave].eep_rev)].push_back(i);
+        }
+    }
+
+    std::vector<std::vector<size_t>> groups;
+    for(auto &item : identities)
+    {
+        groups.push_back(std::move(item.second));
+    }
+
+    // Object list of each identity, read from the first slave of the group.
+    std::vector<std::vector<uint16_t>> lists(groups.size());
+    // Objects each result describes.
+    std::vector<std::vector<uint16_t>> work(_results.size());
+
+    // SOEM reads SDO information with blocking calls, so the slaves are kept busy by one worker each.
+    EthercatWorkers::run(groups.size(), _maxParallel, [&](size_t g)
+    {
+        lists[g] = cache.getObjectList(_results[groups[g][0]].slave);
+    });
+
+    for(size_t g = 0; g < groups.size(); g++)
+    {
+        const std::vector<size_t> &group = groups[g];
+
+        if(lists[g].empty())
+        {
+            for(size_t i : group)
+            {
+                _results[i].ok = false;
+                _results[i].error = "object list can not be read";
+            }
+            continue;
+        }
+
+        // Split the dictionary between the slaves of the group, every object is asked only once.
+        for(size_t k = 0; k < lists[g].size(); k++)
+        {
+            work[group[k % group.size()]].push_back(lists[g][k]);
+        }
+    }
+
+    EthercatWorkers::run(_results.size(), _maxParallel, [&](size_t i)
+    {
+        for(uint16_t index : work[i])
+        {
+            cache.getObject(_results[i].slave, index);
+        }
+        _results[i].durationUs = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now() - start).count();
+    });
+
+    // All objects are cached now, this takes no bus traffic. Only objects that timed out are asked once more.
+    for(size_t g = 0; g < groups.size(); g++)
+    {
+        for(size_t i : groups[g])
+        {
+            EcSlaveDictionary &result = _results[i];
+
+            for(uint16_t index : lists[g])
+            {
+                const EcODObject *object = cache.getObject(result.slave, index);
+                if(object != nullptr)
+                {
+                    result.objects.push_back(object);
+                }
+            }
+        }
+    }
+}
+
+void EthercatODScan::_readValues(std::chrono::steady_clock::time_point start)
+{
+    struct Read
+    {
+        size_t result;
+        const EcODObject *object;
+        const EcODEntry *entry;
+        std::future<EcMailboxResult> future;
+    };
+
+    // Own scheduler if none is attached. Passes are run below, so the budget only limits one pass.
+    std::unique_ptr<EthercatMailbox> own;
+    EthercatMailbox *mailbox = _mailbox;
+    if(mailbox == nullptr)
+    {
+        own.reset(new EthercatMailbox);
+        own->setBudget(UINT32_MAX, UINT32_MAX);
+        mailbox = own.get();
+    }
+
+    EcMailboxStats base = mailbox->getStats();
+    std::vector<Read> reads;
+    uint32_t submitted = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    for(size_t i = 0; i < _results.size(); i++)
+    {
+        if(!_results[i].ok)
+        {
+            continue;
+        }
+
+        for(const EcODObject *object : _results[i].objects)
+        {
+            for(const EcODEntry &entry : object->entries)
+            {
+                // Readable in PRE_OP, SAFE_OP or OP.
+                if(entry.access & 0x07)
+                {
+                    reads.push_back({i, object, &entry, mailbox->read(_results[i].slave, object->index, entry.subindex)});
+                }
+            }
+        }
+    }
+
+    // Without cyclic thread the scheduler is run here, each pass is one frame of its own.
+    bool expired = false;
+    if(own)
+    {
+        EcMailboxStats stats = base;
+        uint64_t finished = 0;
+        std::chrono::steady_clock::time_point progress = std::chrono::steady_clock::now();
+
+        while(finished < reads.size())
+        {
+            own->queue();
+            own->service();
+            // A reply is not there before the next frame, give the slaves time for it.
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            stats = own->getStats();
+
+            /*
+            Transfers fail on their own after the mailbox timeout. The deadline is only a guard against a loop 
+            that stops making progress.
+            */
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if(stats.completed + stats.failed - base.completed - base.failed > finished)
+            {
+                finished = stats.completed + stats.failed - base.completed - base.failed;
+                progress = now;
+            }
+            else if(std::chrono::duration_cast<std::chrono::microseconds>(now - progress).count() > 2 * EC_TIMEOUTRXM)
+            {
+                expired = true;
+                break;
+            }
+        }
+    }
+
+    for(Read &read : reads)
+    {
+        // Transfers left after the deadline have no value, the slave failed.
+        if( expired && (read.future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) )
+        {
+            _results[read.result].ok = false;
+            _results[read.result].error = "mailbox transfers stopped before all values were read";
+            continue;
+        }
+
+        EcMailboxResult value = read.future.get();
+        EcSlaveDictionary &result = _results[read.result];
+        uint32_t key = ((uint32_t)read.object->index << 8) | read.entry->subindex;
+
+        uint32_t done = submitted + value.durationUs;
+
+        if(value.ok)
+        {
+            result.values[key] = std::move(value.data);
+        }
+        else if(value.abortCode == 0)
+        {
+            // Segmented transfers, or no reply in time. Repeat it blocking.
+            std::vector<uint8_t> data((read.entry->bitLength + 7) / 8);
+            if( !data.empty() && (_ethercat.readSDO(result.slave, read.object->index, read.entry->subindex, (int)data.size(), data.data()) > 0) )
+            {
+                result.values[key] = std::move(data);
+            }
+            done = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+        // Objects the slave refuses to read (abort code) have no value.
+
+        if(done > result.durationUs)
+        {
+            result.durationUs = done;
+        }
+    }
+}
+
+bool EthercatODScan::writeJson(const std::string &path)
+{
+    std::string out;
+    char line[160];
+
+    out.reserve(1 << 20);
+    out += "{\n  \"slaves\": [";
+
+    for(size_t i = 0; i < _results.size(); i++)
+    {
+        const EcSlaveDictionary &result = _results[i];
+        const ec_slavet &slave = ec_slave[result.slave];
+
+        snprintf(line, sizeof(line), "%s\n    {\n      \"slave\": %u,\n      \"vendor\": %u,\n      \"product\": %u,\n      \"revision\": %u,\n",
+                 (i > 0) ? "," : "", result.slave, slave.eep_man, slave.eep_id, slave.eep_rev);
+        out += line;
+        out += "      \"name\": " + _jsonString(slave.name) + ",\n";
+        out += std::string("      \"ok\": ") + (result.ok ? "true" : "false") + ",\n";
+        out += "      \"error\": " + _jsonString(result.error) + ",\n";
+        out += "      \"durationUs\": " + std::to_string(result.durationUs) + ",\n";
+        out += "      \"objects\": [";
+
+        for(size_t k = 0; k < result.objects.size(); k++)
+        {
+            const EcODObject &object = *result.objects[k];
+
+            snprintf(line, sizeof(line), "%s\n        {\"index\": %u, \"objectCode\": %u, \"dataType\": %u, \"maxSub\": %u, \"name\": ",
+                     (k > 0) ? "," : "", object.index, object.objectCode, object.dataType, object.maxSub);
+            out += line;
+            out += _jsonString(object.name) + ", \"entries\": [";
+
+            for(size_t e = 0; e < object.entries.size(); e++)
+            {
+                const EcODEntry &entry = object.entries[e];
+
+                snprintf(line, sizeof(line), "%s\n          {\"subindex\": %u, \"dataType\": %u, \"bitLength\": %u, \"access\": %u, \"name\": ",
+                         (e > 0) ? "," : "", entry.subindex, entry.dataType, entry.bitLength, entry.access);
+                out += line;
+                out += _jsonString(entry.name);
+
+                auto it = result.values.find(((uint32_t)object.index << 8) | entry.subindex);
+                if(it == result.values.end())
+                {
+                    out += ", \"data\": null, \"value\": null}";
+                    continue;
+                }
+
+                out += ", \"data\": \"";
+                for(uint8_t byte : it->second)
+                {
+                    snprintf(line, sizeof(line), "%2.2x", byte);
+                    out += line;
+                }
+                out += "\", \"value\": " + _jsonValue(entry.dataType, it->second) + "}";
+            }
+            out += "]}";
+        }
+        out += "\n      ]\n    }";
+    }
+    out += "\n  ]\n}\n";
+
+    return _writeFile(path, out);
+}
+
+bool EthercatODScan::writeBinary(const std::string &path)
+{
+    std::string out;
+
+    auto u8 = [&out](uint8_t value) {out += (char)value;};
+    auto u16 = [&out](uint16_t value) {out += (char)(value & 0xFF); out += (char)(value >> 8);};
+    auto u32 = [&u16](uint32_t value) {u16((uint16_t)(value & 0xFFFF)); u16((uint16_t)(value >> 16));};
+    auto str = [&out](const std::string &text)
+    {
+        size_t size = (text.size() > 255) ? 255 : text.size();
+        out += (char)size;
+        out.append(text, 0, size);
+    };
+
+    out.reserve(1 << 20);
+    out += "ECOD";
+    u16(2);
+    u16((uint16_t)_results.size());
+
+    for(const EcSlaveDictionary &result : _results)
+    {
+        const ec_slavet &slave = ec_slave[result.slave];
+
+        u16(result.slave);
+        u32(slave.eep_man);
+        u32(slave.eep_id);
+        u32(slave.eep_rev);
+        str(slave.name);
+        u16((uint16_t)result.objects.size());
+
+        for(const EcODObject *object : result.objects)
+        {
+            u16(object->index);
+            u16(object->dataType);
+            u8(object->objectCode);
+            u8(object->maxSub);
+            str(object->name);
+            u16((uint16_t)object->entries.size());
+
+            for(const EcODEntry &entry : object->entries)
+            {
+                u8(entry.subindex);
+                u16(entry.dataType);
+                u16(entry.bitLength);
+                u16(entry.access);
+                str(entry.name);
+
+                auto it = result.values.find(((uint32_t)object->index << 8) | entry.subindex);
+                if(it == result.values.end())
+                {
+                    u16(0xFFFF);
+                    continue;
+                }
+
+                u16((uint16_t)it->second.size());
+                out.append((const char*)it->second.data(), it->second.size());
+            }
+        }
+    }
+
+    return _writeFile(path, out);
+}
+
+bool EthercatODScan::_writeFile(const std::string &path, const std::string &data)
+{
+    if(path == "-")
+    {
+        return (fwrite(data.data(), 1, data.size(), stdout) == data.size());
+    }
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if(file == NULL)
+    {
+        errorMessage = "EthercatODScan error: can not open " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    bool ok = (fwrite(data.data(), 1, data.size(), file) == data.size());
+    ok &= (fclose(file) == 0);
+
+    if(!ok)
+    {
+        errorMessage = "EthercatODScan error: can not write " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+std::string EthercatODScan::formatValue(uint16_t data_type, const std::vector<uint8_t> &data)
+{
+    // Value in a zero padded buffer, so short replies read as small numbers.
+    union
+    {
+        uint8_t bytes[8];
+        uint8_t u8;
+        int8_t i8;
+        uint16_t u16;
+        int16_t i16;
+        uint32_t u32;
+        int32_t i32;
+        uint64_t u64;
+        int64_t i64;
+        float r32;
+        double r64;
+    } value;
+
+    char str[64];
+
+    memset(&value, 0, sizeof(value));
+    memcpy(value.bytes, data.data(), (data.size() < sizeof(value)) ? data.size() : sizeof(value));
+
+    switch(data_type)
+    {
+        case ECT_BOOLEAN:
+            return value.u8 ? "TRUE" : "FALSE";
+        case ECT_INTEGER8:
+            snprintf(str, sizeof(str), "0x%2.2x / %d", (uint8_t)value.i8, value.i8);
+            break;
+        case ECT_INTEGER16:
+            snprintf(str, sizeof(str), "0x%4.4x / %d", (uint16_t)value.i16, value.i16);
+            break;
+        case ECT_INTEGER24:
+            // Sign extend the three bytes.
+            value.i32 = (int32_t)(value.u32 << 8) >> 8;
+            snprintf(str, sizeof(str), "0x%8.8x / %d", (uint32_t)value.i32, value.i32);
+            break;
+        case ECT_INTEGER32:
+            snprintf(str, sizeof(str), "0x%8.8x / %d", (uint32_t)value.i32, value.i32);
+            break;
+        case ECT_INTEGER64:
+            snprintf(str, sizeof(str), "0x%16.16" PRIx64 " / %" PRId64, value.u64, value.i64);
+            break;
+        case ECT_UNSIGNED8:
+        case ECT_BIT1: case ECT_BIT2: case ECT_BIT3: case ECT_BIT4:
+        case ECT_BIT5: case ECT_BIT6: case ECT_BIT7: case ECT_BIT8:
+            snprintf(str, sizeof(str), "0x%2.2x / %u", value.u8, value.u8);
+            break;
+        case ECT_UNSIGNED16:
+            snprintf(str, sizeof(str), "0x%4.4x / %u", value.u16, value.u16);
+            break;
+        case ECT_UNSIGNED24:
+        case ECT_UNSIGNED32:
+            snprintf(str, sizeof(str), "0x%8.8x / %u", value.u32, value.u32);
+            break;
+        case ECT_UNSIGNED64:
+            snprintf(str, sizeof(str), "0x%16.16" PRIx64 " / %" PRIu64, value.u64, value.u64);
+            break;
+        case ECT_REAL32:
+            snprintf(str, sizeof(str), "%f", value.r32);
+            break;
+        case ECT_REAL64:
+            snprintf(str, sizeof(str), "%f", value.r64);
+            break;
+        case ECT_VISIBLE_STRING:
+            return "\"" + std::string(data.begin(), std::find(data.begin(), data.end(), 0)) + "\"";
+        case ECT_OCTET_STRING:
+        {
+            std::string text;
+            for(uint8_t byte : data)
+            {
+                snprintf(str, sizeof(str), "0x%2.2x ", byte);
+                text += str;
+            }
+            return text;
+        }
+        default:
+            return "Unknown type";
+    }
+
+    return str;
+}
+
+std::string EthercatODScan::_jsonValue(uint16_t data_type, const std::vector<uint8_t> &data)
+{
+    switch(data_type)
+    {
+        case ECT_BOOLEAN:
+            return (!data.empty() && data[0]) ? "true" : "false";
+        case ECT_VISIBLE_STRING:
+            return _jsonString(std::string(data.begin(), std::find(data.begin(), data.end(), 0)));
+        case ECT_OCTET_STRING:
+            return "null";
+        default:
+            break;
+    }
+
+    std::string text = formatValue(data_type, data);
+
+    // Numbers are formatted "hex / decimal", JSON takes the decimal part.
+    size_t pos = text.find(" / ");
+    if(pos != std::string::npos)
+    {
+        return text.substr(pos + 3);
+    }
+
+    if(text == "Unknown type")
+    {
+        return "null";
+    }
+
+    return text;
+}
+
+std::string EthercatODScan::_jsonString(const std::string &text)
+{
+    std::string out = "\"";
+    char code[8];
+
+    for(char c : text)
+    {
+        if( (c == '"') || (c == '\\') )
+        {
+            out += '\\';
+            out += c;
+        }
+        else if((unsigned char)c < 0x20)
+        {
+            snprintf(code, sizeof(code), "\\u%4.4x", (unsigned char)c);
+            out += code;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+
+    return out + "\"";
+}
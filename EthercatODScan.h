@@ -0,0 +1,128 @@
+#ifndef _ETHERCATODSCAN_H
+#define _ETHERCATODSCAN_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include "SimpleEthercat.h"
+#include "EthercatODCache.h"
+#include "EthercatMailbox.h"
+
+// ##################################################################################
+// Data structures:
+
+// Object dictionary of one slave found by EthercatODScan::scan().
+struct EcSlaveDictionary
+{
+    uint16_t slave;
+
+    bool ok;
+
+    std::string error;
+
+    // Time from the start of the scan until the slave was done.
+    uint32_t durationUs;
+
+    // Objects in slave order. They point into the EthercatODCache of the master and stay valid until it is cleared.
+    std::vector<const EcODObject*> objects;
+
+    // Values of the readable entries, key is index << 8 | subindex. An entry that could not be read is missing.
+    std::map<uint32_t, std::vector<uint8_t>> values;
+};
+
+// ###################################################################################
+// EthercatODScan class:
+
+/**
+ * @brief Scan of the CoE object dictionaries of all slaves at once.
+ * Descriptions are read through the EthercatODCache of the master. Slaves with the same identity share one
+ * dictionary, and its objects are split between these slaves, so 30 identical drives describe 1/30 of the
+ * dictionary each, all in parallel. Values are read through the mailbox scheduler, with one transfer in
+ * flight on every slave. Values larger than the mailbox are read afterwards with SimpleEthercat::readSDO().
+ *
+ * Binary file format, little endian, strings are u8 length and bytes:
+ *
+ *      "ECOD" u16 version=2 u16 slaves
+ *      per slave:  u16 slave u32 vendor u32 product u32 revision string name u16 objects
+ *      per object: u16 index u16 datatype u8 objectcode u8 maxsub string name u16 entries
+ *      per entry:  u8 subindex u16 datatype u16 bitlength u16 access string name u16 size (0xffff = no value) bytes
+ *
+ * Version 1 had u8 entries, which wrapped for objects with 256 entries (subindex 0 to 255).
+ *
+ * @note Call in PRE_OP or SAFE_OP, after SimpleEthercat::configSlaves(). Do not run other SDO transfers to the
+ * scanned slaves meanwhile, except through an attached mailbox scheduler.
+ */
+class EthercatODScan
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    EthercatODScan(SimpleEthercat &ethercat) : _ethercat(ethercat) {}
+
+    /**
+     * @brief Read descriptions, and values if selected, of the slaves.
+     * @param slaves to scan, empty for all slaves with CoE.
+     * @return true if all slaves successed. See getResults() for each slave.
+     */
+    bool scan(const std::vector<uint16_t> &slaves = std::vector<uint16_t>(), bool values = true);
+
+    // Set maximum number of slaves that are described at the same time. Default is 32.
+    void setMaxParallel(int num) {_maxParallel = (num < 1) ? 1 : num;}
+
+    /**
+     * @brief Read values through a mailbox scheduler that is attached to the master and served by the cyclic
+     * thread. Without one (default), scan() runs the passes of its own scheduler.
+     */
+    void setMailbox(EthercatMailbox *mailbox) {_mailbox = mailbox;}
+
+    // Return results of the last scan().
+    const std::vector<EcSlaveDictionary>& getResults(void) {return _results;}
+
+    /**
+     * @brief Write the results as JSON. Path "-" writes to stdout.
+     * @return true if successed.
+     */
+    bool writeJson(const std::string &path);
+
+    /**
+     * @brief Write the results in the binary format above.
+     * @return true if successed.
+     */
+    bool writeBinary(const std::string &path);
+
+    // Return value as text, e.g. "0x0010 / 16" or "\"name\"".
+    static std::string formatValue(uint16_t data_type, const std::vector<uint8_t> &data);
+
+private:
+
+    SimpleEthercat &_ethercat;
+
+    EthercatMailbox *_mailbox = nullptr;
+
+    int _maxParallel = 32;
+
+    std::vector<EcSlaveDictionary> _results;
+
+    // Describe the dictionaries of the slaves. A slave whose object list can not be read fails.
+    void _describe(std::chrono::steady_clock::time_point start);
+
+    // Read the values of all readable entries.
+    void _readValues(std::chrono::steady_clock::time_point start);
+
+    // Return value as JSON number or string.
+    static std::string _jsonValue(uint16_t data_type, const std::vector<uint8_t> &data);
+
+    static std::string _jsonString(const std::string &text);
+
+    // Write data to a file, or to stdout for path "-".
+    bool _writeFile(const std::string &path, const std::string &data);
+};
+
+#endif
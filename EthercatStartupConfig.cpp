@@ -0,0 +1,390 @@
+#include "EthercatStartupConfig.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include "EthercatWorkers.h"
+
+// ##################################################################################
+// Local helpers:
+
+// Parse decimal or 0x hex number. Return false if token is not a complete number.
+static bool _parseNumber(const std::string &token, int64_t &value)
+{
+    if(token.empty())
+    {
+        return false;
+    }
+
+    char *end = nullptr;
+    errno = 0;
+    if(token[0] == '-')
+    {
+        value = strtoll(token.c_str(), &end, 0);
+    }
+    else
+    {
+        value = (int64_t)strtoull(token.c_str(), &end, 0);
+    }
+
+    return (errno == 0) && (end != nullptr) && (*end == 0);
+}
+
+// Parse key=value token with a number as value.
+static bool _parseKey(const std::string &token, const char *key, int64_t &value)
+{
+    size_t len = strlen(key);
+
+    if( (token.compare(0, len, key) != 0) || (token.size() <= len) || (token[len] != '=') )
+    {
+        return false;
+    }
+
+    return _parseNumber(token.substr(len + 1), value);
+}
+
+// Return size in bytes of a type name, 0 if unknown.
+static uint8_t _typeSize(const std::string &type)
+{
+    if( (type == "u8") || (type == "i8") ) return 1;
+    if( (type == "u16") || (type == "i16") ) return 2;
+    if( (type == "u32") || (type == "i32") ) return 4;
+    if( (type == "u64") || (type == "i64") ) return 8;
+    return 0;
+}
+
+// Return true if the value parsed from token is in the range of a type. 64 bit values are taken as bit patterns.
+static bool _typeFits(const std::string &type, const std::string &token, int64_t value)
+{
+    uint8_t size = _typeSize(type);
+
+    if( (type[0] == 'u') && (token[0] == '-') )
+    {
+        return false;
+    }
+    if(size == 8)
+    {
+        return true;
+    }
+
+    int64_t bits = size * 8;
+    if(type[0] == 'u')
+    {
+        return (value >= 0) && (value < ((int64_t)1 << bits));
+    }
+
+    return (value >= -((int64_t)1 << (bits - 1))) && (value < ((int64_t)1 << (bits - 1)));
+}
+
+// ##################################################################################
+// EthercatStartupConfig class:
+
+bool EthercatStartupConfig::load(const std::string &path)
+{
+    std::ifstream file(path);
+
+    if(!file.is_open())
+    {
+        errorMessage = "EthercatStartupConfig error: Can not open " + path + ".";
+        return false;
+    }
+
+    std::stringstream text;
+    text << file.rdbuf();
+
+    return parse(text.str());
+}
+
+bool EthercatStartupConfig::parse(const std::string &text)
+{
+    std::istringstream stream(text);
+    std::string line;
+    int line_num = 0;
+
+    _sections.clear();
+    _plan.clear();
+
+    while(std::getline(stream, line))
+    {
+        line_num++;
+
+        size_t comment = line.find('#');
+        if(comment != std::string::npos)
+        {
+            line.erase(comment);
+        }
+
+        if(!_parseLine(line, line_num))
+        {
+            _sections.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool EthercatStartupConfig::_parseLine(const std::string &line, int line_num)
+{
+    std::istringstream stream(line);
+    std::vector<std::string> tokens;
+    std::string token;
+
+    while(stream >> token)
+    {
+        tokens.push_back(token);
+    }
+
+    if(tokens.empty())
+    {
+        return true;
+    }
+
+    std::string prefix = "EthercatStartupConfig error: line " + std::to_string(line_num) + ": ";
+    int64_t a, b;
+
+    if(tokens[0] == "slave")
+    {
+        _Section section = {};
+        bool hasVendor = false;
+        bool hasProduct = false;
+
+        section.line = line_num;
+        for(size_t i = 1; i < tokens.size(); i++)
+        {
+            if(_parseKey(tokens[i], "vendor", a)) { section.vendor = (uint32_t)a; hasVendor = true; }
+            else if(_parseKey(tokens[i], "product", a)) { section.product = (uint32_t)a; hasProduct = true; }
+            else if(_parseKey(tokens[i], "revision", a)) { section.revision = (uint32_t)a; section.hasRevision = true; }
+            else if(_parseKey(tokens[i], "position", a))
+            {
+                if( (a < 1) || (a >= EC_MAXSLAVE) )
+                {
+                    errorMessage = prefix + "position " + std::to_string(a) + " is out of range 1.." + std::to_string(EC_MAXSLAVE - 1) + ".";
+                    return false;
+                }
+                section.position = (uint16_t)a;
+            }
+            else
+            {
+                errorMessage = prefix + "unknown slave parameter " + tokens[i] + ".";
+                return false;
+            }
+        }
+        if(!hasVendor || !hasProduct)
+        {
+            errorMessage = prefix + "slave needs vendor and product.";
+            return false;
+        }
+        _sections.push_back(section);
+        return true;
+    }
+
+    if(_sections.empty())
+    {
+        errorMessage = prefix + "command before first slave line.";
+        return false;
+    }
+
+    _Section &section = _sections.back();
+
+    if(tokens[0] == "sdo")
+    {
+        uint8_t size = (tokens.size() == 5) ? _typeSize(tokens[3]) : 0;
+        int64_t value;
+        if( (size == 0) || !_parseNumber(tokens[1], a) || !_parseNumber(tokens[2], b) || !_parseNumber(tokens[4], value) ||
+            (a < 0) || (a > 0xFFFF) || (b < 0) || (b > 0xFF) )
+        {
+            errorMessage = prefix + "expected: sdo <index> <subindex> <type> <value>.";
+            return false;
+        }
+        if(!_typeFits(tokens[3], tokens[4], value))
+        {
+            errorMessage = prefix + "value " + tokens[4] + " is out of range for " + tokens[3] + ".";
+            return false;
+        }
+        section.sdo.push_back({(uint16_t)a, (uint8_t)b, size, (uint64_t)value});
+        return true;
+    }
+
+    if( (tokens[0] == "pdo") || (tokens[0] == "pdomap") )
+    {
+        // pdo assign entries are PDO indices (16 bit), pdomap entries are index:sub:bitlength (32 bit).
+        uint8_t size = (tokens[0] == "pdo") ? 2 : 4;
+        if( (tokens.size() < 2) || !_parseNumber(tokens[1], a) || (a < 0) || (a > 0xFFFF) || (tokens.size() - 2 > 0xFE) )
+        {
+            errorMessage = prefix + "expected: " + tokens[0] + " <index> <entry> ...";
+            return false;
+        }
+        uint16_t index = (uint16_t)a;
+        section.sdo.push_back({index, 0, 1, 0});
+        for(size_t i = 2; i < tokens.size(); i++)
+        {
+            if(!_parseNumber(tokens[i], b) || (b < 0) || (b >= ((int64_t)1 << (size * 8))))
+            {
+                errorMessage = prefix + "invalid entry " + tokens[i] + ".";
+                return false;
+            }
+            section.sdo.push_back({index, (uint8_t)(i - 1), size, (uint64_t)b});
+        }
+        section.sdo.push_back({index, 0, 1, (uint64_t)(tokens.size() - 2)});
+        return true;
+    }
+
+    if(tokens[0] == "dc")
+    {
+        b = 0;
+        if( (tokens.size() < 2) || (tokens.size() > 3) || !_parseNumber(tokens[1], a) || (a <= 0) ||
+            ((tokens.size() == 3) && !_parseNumber(tokens[2], b)) )
+        {
+            errorMessage = prefix + "expected: dc <sync0 cycle ns> [<sync0 shift ns>].";
+            return false;
+        }
+        // SYNC0 cycle is an unsigned 32 bit register, the shift a signed 32 bit value.
+        if( (a > (int64_t)UINT32_MAX) || (b < (int64_t)INT32_MIN) || (b > (int64_t)INT32_MAX) )
+        {
+            errorMessage = prefix + "sync0 cycle or shift out of 32 bit range.";
+            return false;
+        }
+        section.hasDc = true;
+        section.sync0Cycle = (uint32_t)a;
+        section.sync0Shift = (int32_t)b;
+        return true;
+    }
+
+    errorMessage = prefix + "unknown command " + tokens[0] + ".";
+    return false;
+}
+
+bool EthercatStartupConfig::compile(void)
+{
+    _plan.clear();
+
+    // Expected identities first, so a wrong device is reported before anything is written.
+    for(const _Section &section : _sections)
+    {
+        if(section.position == 0)
+        {
+            continue;
+        }
+        uint16_t s = section.position;
+        if( (s > ec_slavecount) || (ec_slave[s].eep_man != section.vendor) || (ec_slave[s].eep_id != section.product) ||
+            (section.hasRevision && (ec_slave[s].eep_rev != section.revision)) )
+        {
+            char str[200];
+            sprintf(str, "EthercatStartupConfig error: line %d: slave %d is not vendor 0x%8.8x product 0x%8.8x.",
+                    section.line, s, section.vendor, section.product);
+            errorMessage = str;
+            return false;
+        }
+    }
+
+    for(int cnt = 1; cnt <= ec_slavecount; cnt++)
+    {
+        _SlavePlan plan = {};
+        plan.slave = cnt;
+
+        // Sections apply in file order, a later dc command replaces an earlier one.
+        for(const _Section &section : _sections)
+        {
+            bool match = (ec_slave[cnt].eep_man == section.vendor) && (ec_slave[cnt].eep_id == section.product) &&
+                         (!section.hasRevision || (ec_slave[cnt].eep_rev == section.revision)) &&
+                         ((section.position == 0) || (section.position == cnt));
+            if(!match)
+            {
+                continue;
+            }
+            plan.sdo.insert(plan.sdo.end(), section.sdo.begin(), section.sdo.end());
+            if(section.hasDc)
+            {
+                plan.hasDc = true;
+                plan.sync0Cycle = section.sync0Cycle;
+                plan.sync0Shift = section.sync0Shift;
+            }
+        }
+
+        if( !plan.sdo.empty() || plan.hasDc )
+        {
+            _plan.push_back(std::move(plan));
+        }
+    }
+
+    return true;
+}
+
+bool EthercatStartupConfig::applyPreOp(SimpleEthercat &ethercat)
+{
+    _results.assign(_plan.size(), EcSlaveConfigResult());
+
+    // The init commands of each slave run in their own worker.
+    EthercatWorkers::run(_plan.size(), _maxParallel, [&](size_t i)
+    {
+        const _SlavePlan &plan = _plan[i];
+        EcSlaveConfigResult &result = _results[i];
+        auto start = std::chrono::steady_clock::now();
+
+        result.slave = plan.slave;
+        result.ok = plan.sdo.empty() || ethercat.writeSDOs(plan.slave, plan.sdo.data(), plan.sdo.size());
+        if(!result.ok)
+        {
+            result.error = "Init commands of slave " + std::to_string(plan.slave) + " failed.";
+        }
+        result.durationUs = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - start).count();
+    });
+
+    for(const EcSlaveConfigResult &result : _results)
+    {
+        if(!result.ok)
+        {
+            errorMessage = "EthercatStartupConfig error: " + result.error + " " + ethercat.errorMessage;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool EthercatStartupConfig::applyDc(void)
+{
+    for(const _SlavePlan &plan : _plan)
+    {
+        if(!plan.hasDc)
+        {
+            continue;
+        }
+        if(!ec_slave[plan.slave].hasdc)
+        {
+            errorMessage = "EthercatStartupConfig error: slave " + std::to_string(plan.slave) + " has no distributed clock.";
+            return false;
+        }
+        ec_dcsync0(plan.slave, TRUE, plan.sync0Cycle, plan.sync0Shift);
+    }
+
+    return true;
+}
+
+bool EthercatStartupConfig::run(SimpleEthercat &ethercat)
+{
+    if(!ethercat.configSlaves())
+    {
+        errorMessage = ethercat.errorMessage;
+        return false;
+    }
+
+    if( !compile() || !applyPreOp(ethercat) )
+    {
+        return false;
+    }
+
+    if( !ethercat.configMap() || !ethercat.configDc() )
+    {
+        errorMessage = ethercat.errorMessage;
+        return false;
+    }
+
+    return applyDc();
+}
@@ -0,0 +1,146 @@
+#ifndef _ETHERCATSTARTUPCONFIG_H
+#define _ETHERCATSTARTUPCONFIG_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <vector>
+#include "SimpleEthercat.h"
+
+// ##################################################################################
+// Data structures:
+
+// Result of the init commands of one slave.
+struct EcSlaveConfigResult
+{
+    uint16_t slave;
+
+    bool ok;
+
+    // Time spent on the init commands of this slave.
+    uint32_t durationUs;
+
+    std::string error;
+};
+
+// ###################################################################################
+// EthercatStartupConfig class:
+
+/**
+ * @brief Declarative startup configuration.
+ * A text file describes the init commands of every slave type. The file is compiled into a plan for the
+ * slaves found on the bus, and the SDO part of the plan runs for all slaves in parallel.
+ *
+ * File format, one command per line, '#' starts a comment, numbers are decimal or 0x hex:
+ *
+ *      slave vendor=<id> product=<id> [revision=<id>] [position=<n>]
+ *      sdo <index> <subindex> <u8|u16|u32|u64|i8|i16|i32|i64> <value>
+ *      pdo <assign index> <pdo index> ...          # e.g. pdo 0x1c12 0x1600 0x1601
+ *      pdomap <pdo index> <entry> ...              # e.g. pdomap 0x1600 0x60400010 0x607a0020
+ *      dc <sync0 cycle ns> [<sync0 shift ns>]
+ *
+ * Commands after a slave line belong to that section. A section without position applies to every slave with
+ * the same vendor and product (and revision if given). A section with position is also an expected identity:
+ * compile() fails if the slave at that position is a different device.
+ * pdo and pdomap write sub 0 = 0, the entries and sub 0 = n, so SimpleEthercat::writeSDOs() can send them as
+ * one complete access transfer. Values must fit their type, pdo entries 16 bit and pdomap entries 32 bit.
+ */
+class EthercatStartupConfig
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    /**
+     * @brief Read and parse a configuration file.
+     * @return true if successed.
+     */
+    bool load(const std::string &path);
+
+    /**
+     * @brief Parse configuration from a string. Same format as the file.
+     * @return true if successed.
+     */
+    bool parse(const std::string &text);
+
+    /**
+     * @brief Build the plan for the slaves found by SimpleEthercat::configSlaves().
+     * Checks expected identities.
+     * @return true if successed.
+     */
+    bool compile(void);
+
+    /**
+     * @brief Run the SDO/PDO init commands of the plan, all slaves in parallel. Slaves must be in PRE_OP.
+     * @return true if all slaves successed. See getResults() for each slave.
+     */
+    bool applyPreOp(SimpleEthercat &ethercat);
+
+    /**
+     * @brief Configure SYNC0 of slaves with a dc command. Call after SimpleEthercat::configDc().
+     * @return true if successed.
+     */
+    bool applyDc(void);
+
+    /**
+     * @brief Complete bring-up to SAFE_OP:
+     * configSlaves(), compile(), applyPreOp(), configMap(), configDc() and applyDc().
+     * @return true if successed.
+     */
+    bool run(SimpleEthercat &ethercat);
+
+    // Set maximum number of slaves that are configured at the same time. Default is 32.
+    void setMaxParallel(int num) {_maxParallel = (num < 1) ? 1 : num;}
+
+    // Return per slave results of the last applyPreOp().
+    const std::vector<EcSlaveConfigResult>& getResults(void) {return _results;}
+
+private:
+
+    // Parsed slave section of the file.
+    struct _Section
+    {
+        uint32_t vendor;
+        uint32_t product;
+        uint32_t revision;
+        bool hasRevision;
+
+        // Zero for a section that applies to all slaves with the identity.
+        uint16_t position;
+
+        std::vector<EcSdoWrite> sdo;
+
+        bool hasDc;
+        uint32_t sync0Cycle;
+        int32_t sync0Shift;
+
+        // Line of the slave command, for error messages.
+        int line;
+    };
+
+    // Compiled commands of one slave.
+    struct _SlavePlan
+    {
+        uint16_t slave;
+        std::vector<EcSdoWrite> sdo;
+        bool hasDc;
+        uint32_t sync0Cycle;
+        int32_t sync0Shift;
+    };
+
+    std::vector<_Section> _sections;
+
+    std::vector<_SlavePlan> _plan;
+
+    std::vector<EcSlaveConfigResult> _results;
+
+    int _maxParallel = 32;
+
+    // Parse one line of the file, commands are added to the last slave section.
+    bool _parseLine(const std::string &line, int line_num);
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "EthercatTrace.h"
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <map>
+
+// ##################################################################################
+// EthercatTrace class:
+
+bool EthercatTrace::init(uint32_t size)
+{
+    if( (size < 2) || (size > (1u << 26)) )
+    {
+        errorMessage = "EthercatTrace error: ring size is out of range.";
+        return false;
+    }
+
+    uint64_t n = 1;
+    while(n < size)
+    {
+        n <<= 1;
+    }
+
+    _mask = 0;
+    _slots.reset(new _Slot[n]);
+    for(uint64_t i = 0; i < n; i++)
+    {
+        _slots[i].seq.store(0, std::memory_order_relaxed);
+    }
+
+    _next.store(0, std::memory_order_relaxed);
+    _triggered.store(false, std::memory_order_relaxed);
+    _tsc0 = _timestamp();
+    _time0 = std::chrono::steady_clock::now();
+    _mask = n - 1;
+
+    return true;
+}
+
+bool EthercatTrace::dumpIfTriggered(void)
+{
+    if( _faultPath.empty() || !_triggered.exchange(false, std::memory_order_acquire) )
+    {
+        return false;
+    }
+
+    return dump(_faultPath);
+}
+
+bool EthercatTrace::dump(const std::string &path)
+{
+    static const char* const cycle_events[] = {"ok", "overrun", "frame_lost", "wkc_low", "skipped"};
+    static const char* const recovery_actions[] = {"ack", "to_op", "reconfig", "lost", "recovered", "found"};
+    static const char* const topology_events[] = {"port_changed", "slave_recovered", "slave_changed", "slave_added", "slave_lost", "config_failed"};
+
+    if(_mask == 0)
+    {
+        errorMessage = "EthercatTrace error: init() was not called.";
+        return false;
+    }
+
+    // Copy the ring first, so the file output does not hold up the writers for long.
+    const uint64_t end = _next.load(std::memory_order_acquire);
+    const uint64_t begin = (end > _mask + 1) ? end - (_mask + 1) : 0;
+    std::vector<EcTraceEvent> events;
+    events.reserve(end - begin);
+
+    for(uint64_t n = begin; n < end; n++)
+    {
+        const _Slot &slot = _slots[n & _mask];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        EcTraceEvent event = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // Skip events that are being written or were overwritten during the copy.
+        if( (seq == n + 1) && (slot.seq.load(std::memory_order_relaxed) == seq) )
+        {
+            events.push_back(event);
+        }
+    }
+
+    // Time stamp counter rate since init().
+    uint64_t tsc1 = _timestamp();
+    double us = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _time0).count();
+    double ticks_per_us = ( (us > 0) && (tsc1 > _tsc0) ) ? (double)(tsc1 - _tsc0) / us : 1.0;
+
+    std::string temp = path + ".tmp";
+    FILE *file = fopen(temp.c_str(), "w");
+    if(file == NULL)
+    {
+        errorMessage = "EthercatTrace error: can not open " + temp + ": " + strerror(errno);
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"cycle\"}},\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"supervision\"}}");
+
+    // Open duration events of each track. An end without begin (begin was overwritten) is dropped.
+    std::map<int, int> open;
+
+    for(const EcTraceEvent &event : events)
+    {
+        double ts = (double)(int64_t)(event.tsc - _tsc0) / ticks_per_us;
+        int sdo_tid = 100 + event.slave;
+
+        switch(event.type)
+        {
+            case TRACE_CYCLE_START:
+                open[0]++;
+                fprintf(file, ",\n{\"name\":\"cycle\",\"ph\":\"B\",\"pid\":1,\"tid\":0,\"ts\":%.3f}", ts);
+            break;
+            case TRACE_SEND:
+                fprintf(file, ",\n{\"name\":\"send\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":0,\"ts\":%.3f}", ts);
+            break;
+            case TRACE_RECEIVE:
+                fprintf(file, ",\n{\"name\":\"receive\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"args\":{\"wkc\":%d}}", ts, event.value);
+            break;
+            case TRACE_CYCLE_END:
+                if(open[0] > 0)
+                {
+                    open[0]--;
+                    fprintf(file, ",\n{\"name\":\"cycle\",\"ph\":\"E\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"args\":{\"event\":\"%s\",\"wkc\":%d}}", ts,
+                            (event.aux < 5) ? cycle_events[event.aux] : "?", event.value);
+                }
+                fprintf(file, ",\n{\"name\":\"wkc\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"wkc\":%d}}", ts, event.value);
+            break;
+            case TRACE_STATE:
+                fprintf(file, ",\n{\"name\":\"state 0x%02x\",\"ph\":\"i\",\"s\":\"p\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{\"slave\":%u,\"ok\":%d}}",
+                        event.aux, ts, event.slave, event.value);
+            break;
+            case TRACE_SDO_BEGIN:
+                open[sdo_tid]++;
+                fprintf(file, ",\n{\"name\":\"SDO %s 0x%04x:%02x\",\"ph\":\"B\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"slave\":%u}}",
+                        event.aux ? "write" : "read", (unsigned int)((uint32_t)event.value >> 8), (unsigned int)(event.value & 0xFF), sdo_tid, ts, event.slave);
+            break;
+            case TRACE_SDO_END:
+                if(open[sdo_tid] > 0)
+                {
+                    open[sdo_tid]--;
+                    fprintf(file, ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"wkc\":%d}}", sdo_tid, ts, event.value);
+                }
+            break;
+            case TRACE_RECOVERY:
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"p\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{\"slave\":%u}}",
+                        (event.aux < 6) ? recovery_actions[event.aux] : "?", ts, event.slave);
+            break;
+            case TRACE_TOPOLOGY:
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"p\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{\"slave\":%u}}",
+                        (event.aux < 6) ? topology_events[event.aux] : "?", ts, event.slave);
+            break;
+            default:
+            break;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    bool ok = (ferror(file) == 0);
+    ok &= (fclose(file) == 0);
+
+    if( !ok || (rename(temp.c_str(), path.c_str()) != 0) )
+    {
+        errorMessage = "EthercatTrace error: can not write " + path + ": " + strerror(errno);
+        remove(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
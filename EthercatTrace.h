@@ -0,0 +1,163 @@
+#ifndef _ETHERCATTRACE_H
+#define _ETHERCATTRACE_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <string>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>     // __rdtsc()
+#endif
+
+// ##################################################################################
+// Data structures:
+
+enum EcTraceType : uint8_t
+{
+    // Start of updateProccess().
+    TRACE_CYCLE_START = 0,
+    // Process data frames are sent.
+    TRACE_SEND,
+    // Process data frames are received, value is the working counter.
+    TRACE_RECEIVE,
+    // End of updateProccess(), aux is the EcCycleEvent, value the working counter.
+    TRACE_CYCLE_END,
+    // State request of the master, aux is the requested state, value 1 if successed.
+    TRACE_STATE,
+    // SDO transfer starts, aux is 1 for a write, value is index << 8 | subindex.
+    TRACE_SDO_BEGIN,
+    // SDO transfer ends, value is the working counter.
+    TRACE_SDO_END,
+    // Action of the error check thread, aux is the EcRecoveryAction.
+    TRACE_RECOVERY,
+    // Change found by checkTopology(), aux is the EcTopologyEvent.
+    TRACE_TOPOLOGY,
+    TRACE_TYPE_NUM
+};
+
+// One trace record, 16 bytes.
+struct EcTraceEvent
+{
+    // Time stamp counter of the CPU, or steady clock nanoseconds where there is no TSC.
+    uint64_t tsc;
+
+    EcTraceType type;
+
+    uint8_t aux;
+
+    // Slave number, 0 for the master or all slaves.
+    uint16_t slave;
+
+    int32_t value;
+};
+
+// ###################################################################################
+// EthercatTrace class:
+
+/**
+ * @brief Always-on trace of master events in a fixed size ring.
+ * record() takes one atomic increment, a time stamp counter read and a 16 byte store, so it can stay enabled
+ * in the cyclic thread. The newest events overwrite the oldest. dump() writes the events in the ring as
+ * Chrome trace JSON, which chrome://tracing and Perfetto open. The time stamp counter is converted to time
+ * with the rate measured between init() and the dump, this needs a constant rate TSC (any recent x86 CPU).
+ * For a dump on fault, the master calls trigger() when a cycle fails or a slave is lost, and the error check
+ * thread (see SimpleEthercat::startSupervision()) or any application thread writes the file with dumpIfTriggered().
+ * @note Attach with SimpleEthercat::setTrace() after init().
+ */
+class EthercatTrace
+{
+public:
+
+    // Last error message accured for object.
+    std::string errorMessage;
+
+    /**
+     * @brief Allocate the ring.
+     * @param size is the number of events, rounded up to a power of 2.
+     * @return true if successed.
+     */
+    bool init(uint32_t size = 65536);
+
+    // Record an event. Lock-free, may be called from any thread.
+    inline void record(EcTraceType type, uint16_t slave = 0, uint8_t aux = 0, int32_t value = 0)
+    {
+        if(_mask == 0)
+        {
+            return;
+        }
+
+        uint64_t n = _next.fetch_add(1, std::memory_order_relaxed);
+        _Slot &slot = _slots[n & _mask];
+
+        // Sequence 0 marks the slot as being written for a concurrent dump.
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.event.tsc = _timestamp();
+        slot.event.type = type;
+        slot.event.aux = aux;
+        slot.event.slave = slave;
+        slot.event.value = value;
+        slot.seq.store(n + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Write the events in the ring to a Chrome trace JSON file.
+     * Recording goes on while the file is written.
+     * @return true if successed.
+     */
+    bool dump(const std::string &path);
+
+    // Set file for dumpIfTriggered(). Empty disables the dump on fault (default).
+    void setFaultDumpPath(const std::string &path) {_faultPath = path;}
+
+    // Request a dump on fault. Lock-free, called by the master from the cyclic thread.
+    void trigger(void) {_triggered.store(true, std::memory_order_release);}
+
+    /**
+     * @brief Write the fault dump file if trigger() was called since the last dump.
+     * Call periodically from a thread that may block on file output.
+     * @return true if a file was written.
+     */
+    bool dumpIfTriggered(void);
+
+    // Return number of events recorded since init().
+    uint64_t getEventCount(void) {return _next.load(std::memory_order_relaxed);}
+
+private:
+
+    struct _Slot
+    {
+        // Event number + 1 after the event is written, 0 while it is written.
+        std::atomic<uint64_t> seq;
+        EcTraceEvent event;
+    };
+
+    std::unique_ptr<_Slot[]> _slots;
+
+    uint64_t _mask = 0;
+
+    std::atomic<uint64_t> _next{0};
+
+    std::atomic<bool> _triggered{false};
+
+    std::string _faultPath;
+
+    // Time stamp and clock at init(), to convert time stamps to microseconds.
+    uint64_t _tsc0 = 0;
+    std::chrono::steady_clock::time_point _time0;
+
+    static inline uint64_t _timestamp(void)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+};
+
+#endif
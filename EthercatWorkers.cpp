@@ -0,0 +1,65 @@
+#include "EthercatWorkers.h"
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+// ##################################################################################
+// EthercatWorkers class:
+
+EthercatWorkers::Context::Context()
+{
+    _context = ecx_context;
+    memset(&_elist, 0, sizeof(_elist));
+    _context.elist = &_elist;
+    _context.ecaterror = &_ecaterror;
+
+    _previous = _current;
+    _current = &_context;
+}
+
+EthercatWorkers::Context::~Context()
+{
+    _current = _previous;
+}
+
+bool EthercatWorkers::Context::popError(ec_err_type type, uint16 slave, uint16 index)
+{
+    ec_errort error;
+    bool found = false;
+
+    while(ecx_poperror(&_context, &error))
+    {
+        found |= ( (error.Etype == type) && (error.Slave == slave) && (error.Index == index) );
+    }
+
+    return found;
+}
+
+void EthercatWorkers::run(size_t jobs, int max_parallel, const std::function<void(size_t)> &job)
+{
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        Context context;
+        size_t i;
+        while( (i = next.fetch_add(1)) < jobs )
+        {
+            job(i);
+        }
+    };
+
+    size_t num = std::min(jobs, (size_t)((max_parallel < 1) ? 1 : max_parallel));
+    std::vector<std::thread> threads;
+
+    for(size_t i = 1; i < num; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(std::thread &t : threads)
+    {
+        t.join();
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef _ETHERCATWORKERS_H
+#define _ETHERCATWORKERS_H
+
+// ##################################################################################
+// Include libraries:
+
+#include <cstdint>         // fixed width integer types
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include "ethercat.h"
+
+// ###################################################################################
+// EthercatWorkers class:
+
+/**
+ * @brief Worker threads for blocking mailbox transfers to many slaves at once, and the SOEM context they use.
+ * SOEM pushes mailbox errors (SDO aborts, emergencies, ...) into the error list of its context without a lock.
+ * Threads that make mailbox transfers at the same time must not share one list, so each worker runs with a
+ * Context: a copy of ecx_context with an error list of its own. The copies share port, slaves and groups.
+ * @note Mailbox code calls SOEM as ecx_xxx(EthercatWorkers::context(), ...), which is ecx_context in a thread
+ * without a Context, so behaviour outside the workers does not change.
+ */
+class EthercatWorkers
+{
+public:
+
+    /**
+     * @brief Copy of ecx_context with its own error list. It is the context of the creating thread while it lives.
+     * Take it after hooks (FoE, EoE) are defined on ecx_context, the copy keeps the hooks of that time.
+     */
+    class Context
+    {
+    public:
+
+        Context();
+
+        ~Context();
+
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+        ecx_contextt* get(void) {return &_context;}
+
+        /**
+         * @brief Remove all errors from the list.
+         * @return true if one of them was of type for the slave and index.
+         */
+        bool popError(ec_err_type type, uint16 slave, uint16 index);
+
+    private:
+
+        ecx_contextt _context;
+
+        ec_eringt _elist;
+
+        boolean _ecaterror = FALSE;
+
+        ecx_contextt *_previous;
+    };
+
+    // Return the SOEM context of the calling thread: its innermost Context, else ecx_context.
+    static ecx_contextt* context(void) {return (_current != nullptr) ? _current : &ecx_context;}
+
+    /**
+     * @brief Run job(0) to job(jobs - 1) on up to max_parallel threads, the calling thread is one of them.
+     * Threads take the next job from a shared counter, so a slow slave only delays its own jobs. 
+     * Every thread runs with its own Context.
+     */
+    static void run(size_t jobs, int max_parallel, const std::function<void(size_t)> &job);
+
+    /**
+     * @brief Return the lock that owns the mailbox of a slave.
+     * SOEM does not lock a mailbox, and a reply read by one user is lost for the others. Blocking SDO, object
+     * dictionary, FoE and EoE transfers hold it while they run. The mailbox scheduler of the cyclic thread only
+     * uses try_lock and skips a slave whose mailbox is owned.
+     */
+    static std::mutex& mailbox(uint16 slave) {return _mailbox[(slave < EC_MAXSLAVE) ? slave : 0];}
+
+private:
+
+    static inline thread_local ecx_contextt *_current = nullptr;
+
+    static inline std::mutex _mailbox[EC_MAXSLAVE];
+};
+
+#endif
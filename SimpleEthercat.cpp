@@ -1,4 +1,20 @@
 #include "SimpleEthercat.h"
+#include "EthercatMetrics.h"
+#include "EthercatTrace.h"
+#include "EthercatMailbox.h"
+#include "EthercatWorkers.h"
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <alloca.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 /*
 This macro defines the timeout value (in milliseconds) used for 
@@ -10,9 +26,6 @@ will wait for responses from slaves before considering them as not responding.
 
 bool SimpleEthercat::init(const char* port_name)
 {
-    // Start the thread_errorCheck using a member function
-    // _thread_errorCheck = std::thread(&SimpleEthercat::_ecatcheck, this);
-
     /* initialise SOEM, bind socket to port_name */
     /*
     The function ec_init initializes the SOEM library and binds a socket to the specified network interface (port_name). 
@@ -20,12 +33,43 @@ bool SimpleEthercat::init(const char* port_name)
     If ec_init succeeds, the code inside the if block is executed, indicating that the initialization was successful.
     It prints a message confirming the successful initialization.
     */
+    if(_memoryLock && !_lockMemory())
+    {
+        return false;
+    }
+
     if(!ec_init(port_name))
     {
         errorMessage = "Error SimpleEthercat: No socket connection on " + std::string(port_name) + "\nExecute as root maybe solve problem.";
         return false;
     }
 
+    _redundant = false;
+    _state = EC_STATE_INIT;
+
+    return true;
+}
+
+bool SimpleEthercat::initRedundant(const char* primary_port, const char* secondary_port)
+{
+    // SOEM takes the secondary name as non const.
+    std::string secondary(secondary_port);
+
+    if(_memoryLock && !_lockMemory())
+    {
+        return false;
+    }
+
+    if(!ec_init_redundant(primary_port, &secondary[0]))
+    {
+        errorMessage = "Error SimpleEthercat: No socket connection on " + std::string(primary_port) + " and " + 
+                        secondary + "\nExecute as root maybe solve problem.";
+        return false;
+    }
+
+    _redundant = true;
+    _redundancyStats = EcRedundancyStats();
+    _failoverActive = false;
     _state = EC_STATE_INIT;
 
     return true;
@@ -33,6 +77,9 @@ bool SimpleEthercat::init(const char* port_name)
 
 bool SimpleEthercat::configSlaves(void)
 {
+    _startupTiming = EcStartupTiming();
+    _PhaseTimer timer{_startupTiming.configSlavesUs};
+
     /* find and auto-config slaves */
     /*
     The function ec_config_init is called to auto-configure the EtherCAT slaves connected to the network.
@@ -52,7 +99,17 @@ bool SimpleEthercat::configSlaves(void)
         and configures them for communication.
         */
         _slaveCount = ec_slavecount;
+        if(_metrics != nullptr)
+        {
+            _metrics->setSlaveCount(_slaveCount);
+        }
+
+        // New configuration, values written before are not known to be valid anymore.
+        clearSdoWriteCache();
 
+        // ec_config_init() put all slaves back into group 0.
+        _hotplugActive = false;
+        _topologyValid = false;
     }
     else
     {
@@ -62,18 +119,15 @@ bool SimpleEthercat::configSlaves(void)
         return false;
     }
 
-    setPreOperationalState();
+    // ec_config_init() has requested PRE_OP already, so only wait for it. 
+    bool flag = _waitState(EC_STATE_PRE_OP, EC_TIMEOUTSTATE * 5);
 
-    // update read states of slaves.
-    _readStates();
+    _stateResult(EC_STATE_PRE_OP, flag);
 
-    for (int cnt = 1; cnt <= ec_slavecount; cnt++) 
+    if(!flag)
     {
-        if( ec_slave[cnt].state != EC_STATE_PRE_OP )
-        {
-            errorMessage = "Error SimpleEthercat: Ethercat state can not switch to Pre Operational.";
-            return false;
-        }
+        errorMessage = "Error SimpleEthercat: Ethercat state can not switch to Pre Operational.";
+        return false;
     }
 
     _state = EC_STATE_PRE_OP;
@@ -108,6 +162,23 @@ bool SimpleEthercat::configMap(void)
     specific requirements of the EtherCAT network and the connected slaves, byte alignment may or 
     may not be necessary.
     */
+    // Slaves hot-plugged before are part of the new mapping.
+    _hotplugActive = false;
+    _hotplugWkcLoss = 0;
+    _topologyValid = false;
+    for(int slave = 1; slave <= ec_slavecount; slave++)
+    {
+        ec_slave[slave].group = 0;
+    }
+
+    // Drop the data of the previous configuration. The containers give their memory back first, then the arena frees it at once.
+    std::pmr::vector<std::pmr::vector<EcPdoEntry>>(&_pdoPool).swap(_pdoMapping);
+    std::pmr::vector<uint16_t>(&_configArena).swap(_portStatus);
+    _pdoPool.release();
+    _configArena.release();
+
+    _PhaseTimer timer{_startupTiming.configMapUs};
+
     if (_forceByteAlignment)
     {
     _IOmapSize = ec_config_map_aligned(&_IOmap);
@@ -123,11 +194,36 @@ bool SimpleEthercat::configMap(void)
         return false;
     }
 
+    if((size_t)_IOmapSize + _hotplugReserve > sizeof(_IOmap))
+    {
+        errorMessage = "simpleEthercat error: IOmap has no room for the hot-plug reserve.";
+        return false;
+    }
+
+    /*
+    Room for all slaves, so slaves added by checkTopology() never resize it. Reading the mapping takes several 
+    SDO transfers per PDO and object, so it is left to the first getPdoMapping() of a slave.
+    */
+    _pdoMapping.resize(EC_MAXSLAVE);
+    memset(_pdoMappingRead, 0, sizeof(_pdoMappingRead));
+
+    // New mapping, old statistics and output images do not apply anymore.
+    resetCycleStats();
+    _holdOutputs.clear();
+    _safeOutputs.clear();
+    _outputOverride = CYCLE_POLICY_NONE;
+    _skipNext = false;
+    _lastCycleStartValid = false;
+    setWkcDiagnostics(false);
+    _captureTopology();
+
     return true;
 }
 
 bool SimpleEthercat::configDc(void)
 {
+    _PhaseTimer timer{_startupTiming.configDcUs};
+
     // distributed clocks are configured using ec_configdc.
     if(!ec_configdc())
     {
@@ -145,73 +241,83 @@ bool SimpleEthercat::configDc(void)
     return true;
 }
 
+const EcPdoEntry* SimpleEthercat::getPdoMapping(uint16 slave_num, size_t &count)
+{
+    count = 0;
+
+    if( (slave_num < 1) || (slave_num > ec_slavecount) || (slave_num >= _pdoMapping.size()) )
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_pdoMutex);
+    if(!_pdoMappingRead[slave_num])
+    {
+        _readPdoMapping(slave_num);
+        _pdoMappingRead[slave_num] = true;
+    }
+
+    count = _pdoMapping[slave_num].size();
+
+    return (count > 0) ? _pdoMapping[slave_num].data() : nullptr;
+}
+
+const EcPdoEntry* SimpleEthercat::findPdoEntry(uint16 slave_num, uint16 index, uint8 subindex)
+{
+    size_t count;
+    const EcPdoEntry *entries = getPdoMapping(slave_num, count);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        if( (entries[i].index == index) && (entries[i].subindex == subindex) )
+        {
+            return &entries[i];
+        }
+    }
+
+    return nullptr;
+}
+
 void SimpleEthercat::listSlaves(void)
 {
-    _readStates();
+    std::lock_guard<std::mutex> lock(_statusMutex);
+    _updateStates();
     for (int cnt = 1; cnt <= ec_slavecount; cnt++) 
     {
-        std::string str_state;
-        str_state = _slaveStateNum2Str(ec_slave[cnt].state);
+        const char *str_state = _slaveStateNum2Str(_statusTable.state[cnt]);
 
         printf("\nSlave:%2d Name:%s\t RXsize: %3dbytes, TXsize: %3dbytes\t State: %8s\t Delay: %8d[ns]\t Has DC: %1d\n",
                 cnt, ec_slave[cnt].name, ec_slave[cnt].Obits/8, ec_slave[cnt].Ibits/8,
-                str_state.c_str(), ec_slave[cnt].pdelay, ec_slave[cnt].hasdc);
+                str_state, ec_slave[cnt].pdelay, ec_slave[cnt].hasdc);
     }
 }
 
 bool SimpleEthercat::setOperationalState(void)
 {
-    ec_statecheck(0, EC_STATE_OPERATIONAL, 50000);
-    ec_readstate();
-    /*
-    By setting ec_slave[0].state to EC_STATE_OPERATIONAL, the code is indicating that the 
-    first EtherCAT slave is ready to operate and exchange data with the master. This typically 
-    happens after the configuration phase and before the actual data exchange starts in an EtherCAT network.
-    */
-    ec_slave[0].state = EC_STATE_OPERATIONAL;
+    _PhaseTimer timer{_startupTiming.opUs};
 
-    ec_send_processdata();
-    ec_receive_processdata(EC_TIMEOUTRET);
-    
-    /*
-    The code requests the operational state for all slaves by setting their state 
-    to EC_STATE_OPERATIONAL using ec_writestate.
-    */
-    ec_writestate(0);
-    
     /*
-    It ensures that all slaves transition to the operational state by repeatedly 
-    checking their state with ec_statecheck. Once all slaves reach the operational state, 
-    the code continues with the cyclic data exchange loop.
+    Slaves check the outputs of the first process data frame on the way to the operational state, 
+    so process data is exchanged once before the request.
+    It ensures that all slaves transition to the operational state by polling the line state. 
+    Once all slaves reach the operational state, the code continues with the cyclic data exchange loop.
     */
-    ec_statecheck(0, EC_STATE_OPERATIONAL, EC_TIMEOUTSTATE * 4);
-    
-    int chk = 200;
-    /* wait for all slaves to reach OP state */
-    do
-    {
-        ec_writestate(0);
-        /*
-        It ensures that all slaves transition to the operational state by repeatedly 
-        checking their state with ec_statecheck. Once all slaves reach the operational state, 
-        the code continues with the cyclic data exchange loop.
-        */
-        ec_statecheck(0, EC_STATE_OPERATIONAL, 50000);
-    }
-    while (chk-- && (ec_slave[0].state != EC_STATE_OPERATIONAL));
-
-    ec_readstate();
-        
-    for (int i = 1; i <= ec_slavecount; i++) 
+    if(!_requestState(EC_STATE_OPERATIONAL, EC_TIMEOUTSTATE * 5, true))
     {
-        if (ec_slave[i].state != EC_STATE_OPERATIONAL) 
+        for (int i = 1; i <= ec_slavecount; i++) 
         {
-            printf("Slave %d AL status code: %s. Current state: %d\n", i, ec_ALstatuscode2string(ec_slave[i].ALstatuscode), ec_slave[i].state);
-            errorMessage = "Slaves state can not set to operational state.";
-            return false;
+            if (ec_slave[i].state != EC_STATE_OPERATIONAL) 
+            {
+                printf("Slave %d AL status code: %s. Current state: %d\n", i, ec_ALstatuscode2string(ec_slave[i].ALstatuscode), ec_slave[i].state);
+                errorMessage = "Slaves state can not set to operational state.";
+            }
         }
+        _stateResult(EC_STATE_OPERATIONAL, false);
+        return false;
     }
 
+    _stateResult(EC_STATE_OPERATIONAL, true);
+
     _state = EC_STATE_OPERATIONAL;
 
     return true;
@@ -219,96 +325,43 @@ bool SimpleEthercat::setOperationalState(void)
 
 void SimpleEthercat::setInitState(void)
 {
-    ec_statecheck(0, EC_STATE_INIT, 50000);
-    ec_readstate();
-
-    ec_slave[0].state = EC_STATE_INIT;
-
-    ec_send_processdata();
-    ec_receive_processdata(EC_TIMEOUTRET);
-    
-    ec_writestate(0);
+    _stateResult(EC_STATE_INIT, _requestState(EC_STATE_INIT, EC_TIMEOUTSTATE * 5));
 
-    int chk = 200;
-    do
-    {
-        ec_send_processdata();
-        ec_receive_processdata(EC_TIMEOUTRET);
-        ec_statecheck(0, EC_STATE_INIT, 50000);
-    }
-    while (chk-- && (ec_slave[0].state != EC_STATE_INIT));
+    // Slaves may reset their object dictionary in INIT.
+    clearSdoWriteCache();
 
     _state = EC_STATE_INIT;
 }
 
 bool SimpleEthercat::setPreOperationalState(void)
 {
-    ec_statecheck(0, EC_STATE_PRE_OP, 50000);
-    ec_readstate();
-
-    ec_slave[0].state = EC_STATE_PRE_OP;
-
-    ec_send_processdata();
-    ec_receive_processdata(EC_TIMEOUTRET);
-    
-    ec_writestate(0);
+    bool flag = _requestState(EC_STATE_PRE_OP, EC_TIMEOUTSTATE * 5);
 
-    int chk = 200;
-    do
-    {
-        ec_send_processdata();
-        ec_receive_processdata(EC_TIMEOUTRET);
-        ec_statecheck(0, EC_STATE_PRE_OP, 50000);
-    }
-    while (chk-- && (ec_slave[0].state != EC_STATE_PRE_OP));
+    _stateResult(EC_STATE_PRE_OP, flag);
 
     _state = EC_STATE_PRE_OP;
 
-    return true;
+    return flag;
 }
 
 bool SimpleEthercat::setSafeOperationalState(void)
 {
-    bool flag = false;
-
-    // Explicitly request all slaves to enter SAFE_OP state
-    for (int i = 1; i <= ec_slavecount; i++) {
-        ec_slave[i].state = EC_STATE_SAFE_OP;
-    }
-    ec_writestate(0); // Send the state request to all slaves
+    _PhaseTimer timer{_startupTiming.safeOpUs};
 
-    // Wait for all slaves to reach SAFE_OP state
     /*
-    The function ec_statecheck is used to transition all slaves to the SAFE_OP (safe operational) state.
-    It waits for all slaves to reach the SAFE_OP state within a specified timeout.
+    configMap() has requested SAFE_OP for all slaves already, so usually there is only to wait for it.
+    A slow slave is requested again on its own, without holding back the others.
     */
-    /*
-    Here's a breakdown of its parameters and functionality:
-    ec_statecheck(0, EC_STATE_SAFE_OP, EC_TIMEOUTSTATE * 4);
-
-    Parameters:
-    0: 
-    This parameter specifies the group index of the EtherCAT slaves to be checked. 
-    In this case, 0 typically refers to the default group containing all slaves.
-    EC_STATE_SAFE_OP: 
-    This parameter specifies the target operational state to check for. 
-    In this case, it's EC_STATE_SAFE_OP, which indicates the "Safe Operation" state.
-    EC_TIMEOUTSTATE * 4: 
-    This parameter sets the timeout duration for the state check. 
-    EC_TIMEOUTSTATE is a predefined constant representing the default timeout value for state checks. 
-    Multiplying it by 4 extends the timeout duration.
-    */
-    flag = (ec_statecheck(0, EC_STATE_SAFE_OP, EC_TIMEOUTSTATE * 4) == EC_STATE_SAFE_OP);
-
-    // Re-read state to verify
-    ec_readstate();
+    bool flag = transitionSlaves(EC_STATE_SAFE_OP, EC_TIMEOUTSTATE, 3);
 
     /* Update expected Working Counter (WKC)
     expectedWKC represents the expected total number of working counters for both output 
     and input process data frames in the EtherCAT network, and it is used for monitoring and 
     synchronization purposes within the network.
     */
-    _expectedWKC = (ec_group[0].outputsWKC * 2) + ec_group[0].inputsWKC;
+    _updateExpectedWKC(_hotplugActive);
+
+    _stateResult(EC_STATE_SAFE_OP, flag);
 
     // Verify all slaves are in SAFE_OP state
     if (flag)
@@ -319,12 +372,12 @@ bool SimpleEthercat::setSafeOperationalState(void)
     {
         char s[200];
         // Check which slaves failed to reach SAFE_OP
-        for (int i = 1; i <= ec_slavecount; i++) 
+        for (const EcTransitionResult &result : _transitionResults) 
         {
-            if (ec_slave[i].state != EC_STATE_SAFE_OP) 
+            if (!result.ok) 
             {
                 sprintf(s,"Slave %d failed to reach SAFE_OP. State: %2x, StatusCode: %4x : %s\nCheck slave configuration at pre_operational mode.\n",
-                i, ec_slave[i].state, ec_slave[i].ALstatuscode, ec_ALstatuscode2string(ec_slave[i].ALstatuscode));
+                result.slave, result.state, result.alStatusCode, ec_ALstatuscode2string(result.alStatusCode));
                 errorMessage = s;
             }
         }
@@ -334,31 +387,310 @@ bool SimpleEthercat::setSafeOperationalState(void)
 
 }
 
+bool SimpleEthercat::transitionSlaves(uint16 state, uint32_t slave_timeout_us, uint8_t retries)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    _transitionResults.assign(ec_slavecount, EcTransitionResult());
+    for (int i = 1; i <= ec_slavecount; i++)
+    {
+        _transitionResults[i - 1].slave = i;
+    }
+
+    // Nothing to send if the whole line is in the state already.
+    uint16 line;
+    if( (ec_slavecount > 0) && (_readLineState(line) >= ec_slavecount) && (line == state) )
+    {
+        for (EcTransitionResult &result : _transitionResults)
+        {
+            result.ok = true;
+            result.state = state;
+        }
+        ec_slave[0].state = state;
+        _startupTiming.skippedRequests++;
+        return true;
+    }
+
+    ec_slave[0].state = state;
+    ec_writestate(0);
+
+    // Time of the last request and finish flag of each slave, index is slave number - 1.
+    std::vector<std::chrono::steady_clock::time_point> requested(ec_slavecount, start);
+    std::vector<bool> finished(ec_slavecount, false);
+    for (EcTransitionResult &result : _transitionResults)
+    {
+        result.requests = 1;
+    }
+
+    int pending = ec_slavecount;
+    uint32_t sleep_us = _STATE_POLL_MIN_US;
+
+    while(pending > 0)
+    {
+        osal_usleep(sleep_us);
+        sleep_us *= 2;
+        if(sleep_us > _STATE_POLL_MAX_US)
+        {
+            sleep_us = _STATE_POLL_MAX_US;
+        }
+
+        // Read state and AL status code of all slaves.
+        _readStates();
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        for (int i = 1; i <= ec_slavecount; i++)
+        {
+            EcTransitionResult &result = _transitionResults[i - 1];
+            if(finished[i - 1])
+            {
+                continue;
+            }
+
+            uint16 slave_state = ec_slave[i].state;
+            bool reached = (slave_state == state);
+            bool error = ((slave_state & EC_STATE_ERROR) != 0);
+            // An error is acknowledged only after the slave had time to take the last request.
+            int64_t waited_us = std::chrono::duration_cast<std::chrono::microseconds>(now - requested[i - 1]).count();
+            bool late = (waited_us >= slave_timeout_us) || (error && (waited_us >= _STATE_POLL_MAX_US));
+
+            if(!reached && !late)
+            {
+                continue;
+            }
+
+            if(!reached && ((int)result.requests <= (int)retries))
+            {
+                // Request again for this slave only, and acknowledge its error.
+                ec_slave[i].state = state | (error ? EC_STATE_ACK : 0);
+                ec_writestate(i);
+                ec_slave[i].state = slave_state;
+                requested[i - 1] = now;
+                result.requests++;
+                sleep_us = _STATE_POLL_MIN_US;
+                continue;
+            }
+
+            result.ok = reached;
+            result.state = slave_state;
+            result.alStatusCode = ec_slave[i].ALstatuscode;
+            result.timeUs = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+            finished[i - 1] = true;
+            pending--;
+
+            if(_trace != nullptr)
+            {
+                _trace->record(TRACE_STATE, i, (uint8_t)state, reached ? 1 : 0);
+            }
+        }
+    }
+
+    int failed = 0;
+    for (const EcTransitionResult &result : _transitionResults)
+    {
+        if(!result.ok)
+        {
+            failed++;
+        }
+    }
+
+    if(failed > 0)
+    {
+        errorMessage = "SimpleEthercat error: " + std::to_string(failed) + " slaves did not reach state " + _slaveStateNum2Str(state) + ".";
+        return false;
+    }
+
+    ec_slave[0].state = state;
+
+    return true;
+}
+
 void SimpleEthercat::close(void)
 {   
     /* stop SOEM, close socket */
     /*
     Finally, regardless of the outcome, the EtherCAT connection is closed using ec_close.
+    The error check thread uses the socket, so it ends first.
     */
+    stopSupervision();
     ec_close();
+}
+
+bool SimpleEthercat::startSupervision(void)
+{
+    if(_thread_errorCheck.joinable())
+    {
+        return false;
+    }
+
+    _supervisionStop = false;
+    _thread_errorCheck = std::thread(&SimpleEthercat::_ecatcheck, this);
+    return true;
+}
+
+void SimpleEthercat::stopSupervision(void)
+{
+    _supervisionStop = true;
     _joinThreadErrorCheck();
 }
 
 void SimpleEthercat::_readStates(void)
 {
+    std::lock_guard<std::mutex> lock(_statusMutex);
+    ec_readstate();
+    _refreshStatusTable();
+}
+
+void SimpleEthercat::_refreshStatusTable(void)
+{
+    int count = (ec_slavecount < EC_MAXSLAVE) ? ec_slavecount : EC_MAXSLAVE - 1;
+
+    for(int i = 1; i <= count; i++)
+    {
+        _statusTable.state[i] = ec_slave[i].state;
+        _statusTable.alStatusCode[i] = ec_slave[i].ALstatuscode;
+        _statusTable.wkc[i] = ((ec_slave[i].Obits > 0) ? 2 : 0) + ((ec_slave[i].Ibits > 0) ? 1 : 0);
+        _statusTable.group[i] = ec_slave[i].group;
+        _statusTable.lost[i] = ec_slave[i].islost ? 1 : 0;
+        _slaveFailed[i].store(_statusTable.lost[i] || (_statusTable.state[i] != EC_STATE_OPERATIONAL), std::memory_order_relaxed);
+    }
+
+    _statusTable.count = (uint16_t)count;
+}
+
+EcStatusTable SimpleEthercat::getStatusTable(void)
+{
+    std::lock_guard<std::mutex> lock(_statusMutex);
+    return _statusTable;
+}
+
+bool SimpleEthercat::_lineStatusValid(uint32_t &line)
+{
+    if(!_stateCacheEnable)
+    {
+        return false;
+    }
+
+    int64_t time_ns = _lineStatusTimeNs.load(std::memory_order_acquire);
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    if( (time_ns == 0) || (now_ns - time_ns > (int64_t)_stateCacheMaxAgeUs * 1000) )
+    {
+        return false;
+    }
+
+    line = _lineStatus.load(std::memory_order_relaxed);
+    return true;
+}
+
+uint16 SimpleEthercat::_uniformState(void)
+{
+    uint32_t line;
+    if( (ec_slavecount == 0) || !_lineStatusValid(line) || ((line >> 16) != (uint32_t)ec_slavecount) )
+    {
+        return 0;
+    }
+
+    /*
+    The broadcast read ORs the AL status of all slaves. If all slaves answered and the result is one state bit, 
+    every slave is in that state. BOOT (INIT | PRE_OP) and the error flag need the slaves to be read one by one.
+    */
+    uint16 state = (uint16)(line & 0xFFFF);
+    if( (state == EC_STATE_INIT) || (state == EC_STATE_PRE_OP) || (state == EC_STATE_SAFE_OP) || (state == EC_STATE_OPERATIONAL) )
+    {
+        return state;
+    }
+
+    return 0;
+}
+
+void SimpleEthercat::_updateStates(void)
+{
+    uint16 state = _uniformState();
+    if(state != 0)
+    {
+        int count = (ec_slavecount < EC_MAXSLAVE) ? ec_slavecount : EC_MAXSLAVE - 1;
+        for(int i = 1; i <= count; i++)
+        {
+            _statusTable.state[i] = state;
+            _slaveFailed[i].store(_statusTable.lost[i] || (state != EC_STATE_OPERATIONAL), std::memory_order_relaxed);
+        }
+        _statusTable.count = (uint16_t)count;
+        return;
+    }
+
+    // The slaves were read already for this broadcast result.
+    uint32_t line;
+    bool valid = _lineStatusValid(line);
+    if(valid && (line == _tableLineStatus.load(std::memory_order_relaxed)))
+    {
+        return;
+    }
+
     ec_readstate();
+    _refreshStatusTable();
+    _tableLineStatus.store(valid ? line : 0xFFFFFFFF, std::memory_order_relaxed);
+}
+
+bool SimpleEthercat::_allInState(uint16 state)
+{
+    const uint16_t *states = &_statusTable.state[1];
+    int count = _statusTable.count;
+    int i = 0;
+
+#if defined(__SSE2__)
+    // Eight slaves per compare, the mask has two bits for each slave in state.
+    const __m128i expected = _mm_set1_epi16((short)state);
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(states + i));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi16(v, expected)) != 0xFFFF)
+        {
+            return false;
+        }
+    }
+#endif
+
+    uint16 diff = 0;
+    for(; i < count; i++)
+    {
+        diff |= (uint16)(states[i] ^ state);
+    }
+
+    return diff == 0;
 }
 
 int SimpleEthercat::getState(void) 
 {
-    _readStates();
-    return ec_slave[1].state;
+    return getState(1);
 }
 
 int SimpleEthercat::getState(uint16_t slave_id) 
 {
-    _readStates();
-    return ec_slave[slave_id].state;
+    // The broadcast only tells about the slaves on the line.
+    if( (slave_id > ec_slavecount) || (slave_id >= EC_MAXSLAVE) )
+    {
+        return EC_STATE_NONE;
+    }
+
+    uint16 state = _uniformState();
+    if(state != 0)
+    {
+        return state;
+    }
+
+    std::lock_guard<std::mutex> lock(_statusMutex);
+    _updateStates();
+
+    // Slave 0 is the lowest state of all slaves, as ec_readstate() leaves it.
+    return (slave_id == 0) ? ec_slave[0].state : _statusTable.state[slave_id];
+}
+
+void SimpleEthercat::setStateCache(bool flag, uint32_t max_age_us)
+{
+    _stateCacheMaxAgeUs = max_age_us;
+    _lineStatusTimeNs.store(0, std::memory_order_release);
+    _tableLineStatus.store(0xFFFFFFFF, std::memory_order_relaxed);
+    _stateCacheEnable = flag;
 }
 
 uint32_t SimpleEthercat::getManufactureID(uint16_t slave_id)
@@ -383,29 +715,32 @@ uint32_t SimpleEthercat::getProductID(uint16_t slave_id)
 
 void SimpleEthercat::showStates(void)
 {
-    _readStates();
-    for(int i = 1; i<=ec_slavecount ; i++)
+    std::lock_guard<std::mutex> lock(_statusMutex);
+    _updateStates();
+    for(int i = 1; i <= _statusTable.count ; i++)
     {
-        std::string str_state;
-        str_state = _slaveStateNum2Str(ec_slave[i].state);
+        const char *str_state = _slaveStateNum2Str(_statusTable.state[i]);
         
         printf("Slave %2d, State=%8s, StatusCode=0x%4.4x : %s\n",
-            i, str_state.c_str(), ec_slave[i].ALstatuscode, ec_ALstatuscode2string(ec_slave[i].ALstatuscode));
+            i, str_state, _statusTable.alStatusCode[i], ec_ALstatuscode2string(_statusTable.alStatusCode[i]));
 
     }
 }
 
 bool SimpleEthercat::isAllStatesOPT(void)
 {
-    _readStates();
-    
-    for(int i = 1; i<=ec_slavecount ; i++)
+    if(_uniformState() == EC_STATE_OPERATIONAL)
     {
-        if(ec_slave[i].state != EC_STATE_OPERATIONAL)
-        {
-            errorMessage = "Not all slaves reached operational state.";
-            return false;
-        } 
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(_statusMutex);
+    _updateStates();
+    
+    if(!_allInState(EC_STATE_OPERATIONAL))
+    {
+        errorMessage = "Not all slaves reached operational state.";
+        return false;
     }
     return true;
 }
@@ -414,11 +749,12 @@ OSAL_THREAD_FUNC SimpleEthercat::_ecatcheck(/*void* ptr*/)
 {
     int slave;
     //(void)ptr;                  /* Not used */
+    auto lastTopologyCheck = std::chrono::steady_clock::now();
 
    /*
-   continuously monitor the state of EtherCAT slaves.
+   continuously monitor the state of EtherCAT slaves until stopSupervision().
    */
-    while(1)
+    while(!_supervisionStop)
     {
          /*
          State Monitoring: 
@@ -434,7 +770,11 @@ OSAL_THREAD_FUNC SimpleEthercat::_ecatcheck(/*void* ptr*/)
             }
             /* one ore more slaves are not responding */
             ec_group[_currentgroup].docheckstate = FALSE;
+
+            // The states of ec_slave[] are read and changed here, getState() and the others wait until the slaves are handled.
+            std::lock_guard<std::mutex> lock(_statusMutex);
             ec_readstate();
+            _refreshStatusTable();
 
             /*
             Error Handling:
@@ -448,18 +788,27 @@ OSAL_THREAD_FUNC SimpleEthercat::_ecatcheck(/*void* ptr*/)
             */
             for (slave = 1; slave <= ec_slavecount; slave++)
             {
-               if ((ec_slave[slave].group == _currentgroup) && (ec_slave[slave].state != EC_STATE_OPERATIONAL))
+               // Most slaves are fine, find them from the status table without touching ec_slave[].
+               bool supervised = (_statusTable.group[slave] == _currentgroup) || (_hotplugActive && (_statusTable.group[slave] == _HOTPLUG_GROUP));
+               if ( !(supervised && (_statusTable.state[slave] != EC_STATE_OPERATIONAL)) && !_statusTable.lost[slave] )
+               {
+                  continue;
+               }
+
+               if (supervised && (ec_slave[slave].state != EC_STATE_OPERATIONAL))
                {
                   ec_group[_currentgroup].docheckstate = TRUE;
                   if (ec_slave[slave].state == (EC_STATE_SAFE_OP + EC_STATE_ERROR))
                   {
                      printf("ERROR : slave %d is in SAFE_OP + ERROR, attempting ack.\n", slave);
+                     _recoveryAction(slave, RECOVERY_ACK);
                      ec_slave[slave].state = (EC_STATE_SAFE_OP + EC_STATE_ACK);
                      ec_writestate(slave);
                   }
                   else if(ec_slave[slave].state == EC_STATE_SAFE_OP)
                   {
                      printf("WARNING : slave %d is in SAFE_OP, change to OPERATIONAL.\n", slave);
+                     _recoveryAction(slave, RECOVERY_TO_OP);
                      ec_slave[slave].state = EC_STATE_OPERATIONAL;
                      ec_writestate(slave);
                   }
@@ -467,8 +816,10 @@ OSAL_THREAD_FUNC SimpleEthercat::_ecatcheck(/*void* ptr*/)
                   {
                      if (ec_reconfig_slave(slave, EC_TIMEOUTMON))
                      {
+                        _invalidateSdoCache(slave);
                         ec_slave[slave].islost = FALSE;
                         printf("MESSAGE : slave %d reconfigured\n",slave);
+                        _recoveryAction(slave, RECOVERY_RECONFIG);
                      }
                   }
                   else if(!ec_slave[slave].islost)
@@ -479,6 +830,7 @@ OSAL_THREAD_FUNC SimpleEthercat::_ecatcheck(/*void* ptr*/)
                      {
                         ec_slave[slave].islost = TRUE;
                         printf("ERROR : slave %d lost\n",slave);
+                        _recoveryAction(slave, RECOVERY_LOST);
                      }
                   }
                }
@@ -488,17 +840,22 @@ OSAL_THREAD_FUNC SimpleEthercat::_ecatcheck(/*void* ptr*/)
                     {
                         if (ec_recover_slave(slave, EC_TIMEOUTMON))
                         {
+                            _invalidateSdoCache(slave);
                             ec_slave[slave].islost = FALSE;
                             printf("MESSAGE : slave %d recovered\n",slave);
+                            _recoveryAction(slave, RECOVERY_RECOVERED);
                         }
                     }
                     else
                     {
                         ec_slave[slave].islost = FALSE;
                         printf("MESSAGE : slave %d found\n",slave);
+                        _recoveryAction(slave, RECOVERY_FOUND);
                     }
                }
             }
+            // Take over lost flags and requested states.
+            _refreshStatusTable();
             if(!ec_group[_currentgroup].docheckstate)
             {
                 printf("SDCSDC\n");
@@ -507,6 +864,20 @@ OSAL_THREAD_FUNC SimpleEthercat::_ecatcheck(/*void* ptr*/)
             }
                
         }
+
+        // Periodic check for swapped, added and removed slaves.
+        if( (_topologyCheckPeriodMs > 0) && _topologyValid && 
+            (std::chrono::steady_clock::now() - lastTopologyCheck >= std::chrono::milliseconds(_topologyCheckPeriodMs)) )
+        {
+            lastTopologyCheck = std::chrono::steady_clock::now();
+            checkTopology();
+        }
+
+        // Write the trace of a fault here, not in the cyclic thread.
+        if(_trace != nullptr)
+        {
+            _trace->dumpIfTriggered();
+        }
         /*
         Sleep: The function sleeps for a short duration (osal_usleep(10000)) before the next 
         iteration of the loop to avoid busy waiting and reduce CPU usage.
@@ -524,67 +895,2034 @@ void SimpleEthercat::_joinThreadErrorCheck(void)
 }
 
 int SimpleEthercat::readSDO(uint16 slave_num, uint16 index, uint8 subindex, int size, void *buffer)
+{
+    return _readSDO(slave_num, index, subindex, &size, buffer);
+}
+
+int SimpleEthercat::_readSDO(uint16 slave_num, uint16 index, uint8 subindex, int *size, void *buffer)
 {
     int wkc;
-    wkc = ec_SDOread(slave_num, index, subindex, FALSE, &size, buffer, EC_TIMEOUTRXM);
+    auto start = _sdoBegin(slave_num, index, subindex, false);
+    {
+        std::lock_guard<std::mutex> mailbox(EthercatWorkers::mailbox(slave_num));
+        wkc = ecx_SDOread(EthercatWorkers::context(), slave_num, index, subindex, FALSE, size, buffer, EC_TIMEOUTRXM);
+    }
+    _sdoEnd(slave_num, false, start, wkc);
+
+    if(_sdoCacheEnable && (wkc > 0))
+    {
+        std::lock_guard<std::mutex> lock(_sdoMutex);
+        // Drop the cached value if the slave holds something else now.
+        auto it = _sdoCache.find(_sdoCacheKey(slave_num, index, subindex));
+        if( (it != _sdoCache.end()) && 
+            ((it->second.size() != (size_t)*size) || (memcmp(it->second.data(), buffer, *size) != 0)) )
+        {
+            _sdoCache.erase(it);
+        }
+    }
+
     return wkc;
 }
 
+bool SimpleEthercat::_checkSdoSize(uint16 slave_num, uint16 index, uint8 subindex, size_t size)
+{
+    if(!_sdoTypeCheck)
+    {
+        return true;
+    }
+
+    int expected = _odCache.getEntrySize(slave_num, index, subindex);
+
+    if(expected < 0)
+    {
+        _setError("SimpleEthercat error: SDO object is not in the object dictionary.");
+        return false;
+    }
+
+    if((size_t)expected != size)
+    {
+        _setError("SimpleEthercat error: SDO object size is " + std::to_string(expected) + " bytes, not " + std::to_string(size) + ".");
+        return false;
+    }
+
+    return true;
+}
+
 int SimpleEthercat::writeSDO(uint16 slave_num, uint16 index, uint8 subindex, int size, void *buffer)
 {
     int wkc;
-    wkc = ec_SDOwrite(slave_num, index, subindex, FALSE, size, buffer, EC_TIMEOUTRXM);
+    bool useCache = _sdoCacheEnable && (size > 0);
+    uint64_t key = _sdoCacheKey(slave_num, index, subindex);
+
+    if(useCache)
+    {
+        std::lock_guard<std::mutex> lock(_sdoMutex);
+        auto it = _sdoCache.find(key);
+        if( (it != _sdoCache.end()) && (it->second.size() == (size_t)size) && (memcmp(it->second.data(), buffer, size) == 0) )
+        {
+            // Same value already written, no mailbox transfer needed.
+            _sdoWritesSkipped++;
+            return 1;
+        }
+    }
+
+    auto start = _sdoBegin(slave_num, index, subindex, true);
+    {
+        std::lock_guard<std::mutex> mailbox(EthercatWorkers::mailbox(slave_num));
+        wkc = ecx_SDOwrite(EthercatWorkers::context(), slave_num, index, subindex, FALSE, size, buffer, EC_TIMEOUTRXM);
+    }
+    _sdoEnd(slave_num, true, start, wkc);
+
+    if(useCache)
+    {
+        std::lock_guard<std::mutex> lock(_sdoMutex);
+        if(wkc > 0)
+        {
+            _sdoCache[key].assign((uint8_t*)buffer, (uint8_t*)buffer + size);
+        }
+        else
+        {
+            _sdoCache.erase(key);
+        }
+    }
+
     return wkc;
 }
 
 int SimpleEthercat::writeSDO(uint16 slave_num, uint16 index, uint8 subindex, int size, uint8_t buffer)
 {
-    int wkc;
-    wkc = ec_SDOwrite(slave_num, index, subindex, FALSE, size, &buffer, EC_TIMEOUTRXM);
-    return wkc;
+    // Never send more bytes than the widened value holds.
+    uint8_t data[8] = {buffer, 0, 0, 0, 0, 0, 0, 0};
+
+    if( (size < 1) || (size > (int)sizeof(data)) )
+    {
+        _setError("SimpleEthercat error: writeSDO() size must be 1 to 8 bytes.");
+        return 0;
+    }
+
+    return writeSDO(slave_num, index, subindex, size, (void*)data);
+}
+
+bool SimpleEthercat::writeSDOs(uint16 slave_num, const EcSdoWrite *entries, size_t count)
+{
+    bool useCA = (slave_num >= 1) && (slave_num <= ec_slavecount) && (ec_slave[slave_num].CoEdetails & ECT_COEDET_SDOCA);
+    size_t i = 0;
+
+    while(i < count)
+    {
+        // Find the run of entries that write the same object.
+        size_t end = i;
+        while( (end < count) && (entries[end].index == entries[i].index) )
+        {
+            end++;
+        }
+
+        /*
+        Complete access pattern: [sub0 = 0] sub1 .. subN sub0 = N.
+        Subindex 0 is sent as 16 bit in a complete access transfer, followed by the packed entries.
+        */
+        size_t first = ( (entries[i].subindex == 0) && (end - i > 2) ) ? i + 1 : i;
+        size_t n = end - first - 1;
+        bool batch = useCA && (end - first >= 2) && (entries[end - 1].subindex == 0) && (entries[end - 1].value == n);
+        uint8_t buffer[EC_MAXMBX];
+        int size = 2;
+
+        for(size_t k = 0; batch && (k < n); k++)
+        {
+            const EcSdoWrite &entry = entries[first + k];
+            if( (entry.subindex != k + 1) || (entry.size < 1) || (entry.size > 8) || (size + entry.size > (int)sizeof(buffer)) )
+            {
+                batch = false;
+                break;
+            }
+            for(int b = 0; b < entry.size; b++)
+            {
+                buffer[size++] = (uint8_t)(entry.value >> (8 * b));
+            }
+        }
+
+        if(batch)
+        {
+            buffer[0] = (uint8_t)n;
+            buffer[1] = 0;
+
+            auto start = _sdoBegin(slave_num, entries[i].index, 0x00, true);
+            int wkc;
+            {
+                std::lock_guard<std::mutex> mailbox(EthercatWorkers::mailbox(slave_num));
+                wkc = ecx_SDOwrite(EthercatWorkers::context(), slave_num, entries[i].index, 0x00, TRUE, size, buffer, EC_TIMEOUTRXM);
+            }
+            _sdoEnd(slave_num, true, start, wkc);
+
+            // Complete access bypasses the write cache, drop what it knows about this object.
+            std::lock_guard<std::mutex> lock(_sdoMutex);
+            for(size_t k = i; k < end; k++)
+            {
+                _sdoCache.erase(_sdoCacheKey(slave_num, entries[k].index, entries[k].subindex));
+            }
+
+            if(wkc <= 0)
+            {
+                char s[100];
+                sprintf(s, "SimpleEthercat error: Complete access write of 0x%4.4x failed on slave %d.", entries[i].index, slave_num);
+                _setError(s);
+                return false;
+            }
+
+            i = end;
+            continue;
+        }
+
+        for(; i < end; i++)
+        {
+            uint8_t data[8];
+            if( (entries[i].size < 1) || (entries[i].size > 8) )
+            {
+                _setError("SimpleEthercat error: writeSDOs() entry size must be 1 to 8 bytes.");
+                return false;
+            }
+            for(int b = 0; b < entries[i].size; b++)
+            {
+                data[b] = (uint8_t)(entries[i].value >> (8 * b));
+            }
+            if(writeSDO(slave_num, entries[i].index, entries[i].subindex, entries[i].size, (void*)data) <= 0)
+            {
+                char s[100];
+                sprintf(s, "SimpleEthercat error: SDO write 0x%4.4x:%2.2x failed on slave %d.", entries[i].index, entries[i].subindex, slave_num);
+                _setError(s);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void SimpleEthercat::setSdoWriteCache(bool flag)
+{
+    std::lock_guard<std::mutex> lock(_sdoMutex);
+    _sdoCacheEnable = flag;
+    if(!flag)
+    {
+        _sdoCache.clear();
+    }
+}
+
+void SimpleEthercat::clearSdoWriteCache(void)
+{
+    std::lock_guard<std::mutex> lock(_sdoMutex);
+    _sdoCache.clear();
+}
+
+void SimpleEthercat::_setError(const std::string &message)
+{
+    std::lock_guard<std::mutex> lock(_errorMutex);
+    errorMessage = message;
+}
+
+void SimpleEthercat::_invalidateSdoCache(uint16 slave_num)
+{
+    std::lock_guard<std::mutex> lock(_sdoMutex);
+    for(auto it = _sdoCache.begin(); it != _sdoCache.end(); )
+    {
+        if( (it->first >> 24) == slave_num )
+        {
+            it = _sdoCache.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+void SimpleEthercat::setOutputChangeTracking(bool flag)
+{
+    _outputTrackingEnable = flag;
+    _outputShadowValid = false;
+    _outputDirtyRanges.clear();
+
+    if(flag)
+    {
+        // Allocate here so the cyclic path does not.
+        _outputShadow.resize(ec_group[0].Obytes);
+        _outputDirtyRanges.reserve(ec_group[0].Obytes / 2 + 1);
+    }
 }
 
-std::string SimpleEthercat::_slaveStateNum2Str(int num_state)
+void SimpleEthercat::_trackOutputChanges(void)
 {
-    std::string str_state;
+    const uint8_t *outputs = ec_group[0].outputs;
+    uint32_t size = ec_group[0].Obytes;
+
+    _outputDirtyRanges.clear();
+
+    if( (outputs == NULL) || (size == 0) )
+    {
+        return;
+    }
+
+    if( !_outputShadowValid || (_outputShadow.size() != size) )
+    {
+        _outputShadow.assign(outputs, outputs + size);
+        _outputDirtyRanges.reserve(size / 2 + 1);
+        _outputDirtyRanges.push_back({0, size});
+        _outputShadowValid = true;
+        return;
+    }
+
+    uint8_t *shadow = _outputShadow.data();
+    uint32_t i = 0;
+
+    while(i < size)
+    {
+        // Skip equal bytes 8 at a time.
+        if( (i + 8 <= size) && (memcmp(outputs + i, shadow + i, 8) == 0) )
+        {
+            i += 8;
+            continue;
+        }
+        if(outputs[i] == shadow[i])
+        {
+            i++;
+            continue;
+        }
+
+        uint32_t start = i;
+        while( (i < size) && (outputs[i] != shadow[i]) )
+        {
+            shadow[i] = outputs[i];
+            i++;
+        }
 
+        // Join with the previous range when only a few equal bytes separate them.
+        if( !_outputDirtyRanges.empty() && 
+            (start - (_outputDirtyRanges.back().offset + _outputDirtyRanges.back().length) <= 8) )
+        {
+            _outputDirtyRanges.back().length = i - _outputDirtyRanges.back().offset;
+        }
+        else
+        {
+            _outputDirtyRanges.push_back({start, i - start});
+        }
+    }
+}
+
+const char* SimpleEthercat::_slaveStateNum2Str(int num_state)
+{
     switch(num_state)
     {
         case EC_STATE_BOOT:
-            str_state = "Boot";
-        break;
+            return "Boot";
         case EC_STATE_INIT:
-            str_state = "INIT";
-        break;
+            return "INIT";
         case EC_STATE_PRE_OP:
-            str_state = "PRE_OP";
-        break;
+            return "PRE_OP";
         case EC_STATE_SAFE_OP:
-            str_state = "SAFE_OP";
-        break;
+            return "SAFE_OP";
         case EC_STATE_OPERATIONAL:
-            str_state = "OP";
-        break;
+            return "OP";
         case EC_STATE_NONE:
-            str_state = "NONE";
-        break;
+            return "NONE";
         case EC_STATE_ERROR:
-            str_state = "ERROR/ACK";
-        break;
+            return "ERROR/ACK";
         default:
-            str_state = "NONE";
+            return "NONE";
     }
-
-    return  str_state;
 }
 
 bool SimpleEthercat::updateProccess(void)
 {
-    ec_send_processdata();
-    int wkc = ec_receive_processdata(EC_TIMEOUTRET);
-    
-    if(wkc < _expectedWKC)
+    // checkTopology() changes ec_slave[] and ec_slavecount only between two cycles.
+    std::lock_guard<std::mutex> cycle(_cycleMutex);
+
+    auto start = std::chrono::steady_clock::now();
+    bool overrun = false;
+    uint32_t interval = 0;
+
+    if(_trace != nullptr)
+    {
+        _trace->record(TRACE_CYCLE_START);
+    }
+
+    _cycleStats.cycles++;
+
+    if(_lastCycleStartValid)
+    {
+        interval = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(start - _lastCycleStart).count();
+        overrun = (_cycleTimeUs > 0) && (interval > _cycleTimeUs + _cycleJitterUs);
+    }
+    _lastCycleStart = start;
+    _lastCycleStartValid = true;
+
+    if(_skipNext)
+    {
+        _skipNext = false;
+        _cycleStats.skipped++;
+        _lastCycleEvent = CYCLE_SKIPPED;
+        if(_metrics != nullptr)
+        {
+            _metrics->countCycle(CYCLE_SKIPPED, interval, 0, 0, _expectedWKC);
+        }
+        if(_trace != nullptr)
+        {
+            _trace->record(TRACE_CYCLE_END, 0, CYCLE_SKIPPED, 0);
+        }
         return FALSE;
-    
-    return TRUE;
+    }
+
+    uint8_t *outputs = ec_group[0].outputs;
+    uint32_t size = ec_group[0].Obytes;
+
+    // Changes are tracked on the application outputs, not on outputs replaced below.
+    if(_outputTrackingEnable)
+    {
+        _trackOutputChanges();
+    }
+
+    /*
+    Replace the application outputs while the bus is degraded. They are exchanged from the output image, 
+    so the application outputs are kept aside and put back after the exchange. Outputs the application 
+    writes meanwhile are sent as soon as the override ends.
+    */
+    bool replaced = false;
+
+    if( (_outputOverride == CYCLE_POLICY_HOLD_OUTPUTS) && (_holdOutputs.size() == size) )
+    {
+        _appOutputs.assign(outputs, outputs + size);
+        memcpy(outputs, _holdOutputs.data(), size);
+        replaced = true;
+        _cycleStats.degradedCycles++;
+    }
+    else if( (_outputOverride == CYCLE_POLICY_SAFE_OUTPUTS) && (outputs != NULL) )
+    {
+        _appOutputs.assign(outputs, outputs + size);
+        if(_safeOutputs.size() == size)
+        {
+            memcpy(outputs, _safeOutputs.data(), size);
+        }
+        else
+        {
+            memset(outputs, 0, size);
+        }
+        replaced = true;
+        _cycleStats.degradedCycles++;
+    }
+
+    int wkc = _exchange();
+
+    uint32_t exchange_us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    if(exchange_us > _cycleStats.maxExchangeUs)
+    {
+        _cycleStats.maxExchangeUs = exchange_us;
+    }
+    if( (_cycleTimeUs > 0) && (exchange_us > _cycleTimeUs) )
+    {
+        overrun = true;
+    }
+
+    EcCycleEvent event = CYCLE_OK;
+
+    if(wkc < _expectedWKC)
+    {
+        event = (wkc == EC_NOFRAME) ? CYCLE_FRAME_LOST : CYCLE_WKC_LOW;
+        if(event == CYCLE_FRAME_LOST)
+        {
+            _cycleStats.lostFrames++;
+        }
+        else
+        {
+            _cycleStats.wkcErrors++;
+        }
+
+        if(_cyclePolicy[event] == CYCLE_POLICY_RESEND)
+        {
+            _cycleStats.resends++;
+            wkc = _exchange();
+        }
+    }
+
+    if(replaced)
+    {
+        memcpy(outputs, _appOutputs.data(), size);
+    }
+
+    _wkc = wkc;
+
+    bool ok = (wkc >= _expectedWKC);
+
+    if(_redundant)
+    {
+        _updateRedundancyStats(ok, start);
+    }
+
+    if(!ok)
+    {
+        _cycleStats.consecutiveErrors++;
+        _countSlaveCycleErrors();
+        _applyCyclePolicy(_cyclePolicy[event]);
+    }
+    else
+    {
+        _cycleStats.consecutiveErrors = 0;
+    }
+
+    if(overrun)
+    {
+        _cycleStats.overruns++;
+        _applyCyclePolicy(_cyclePolicy[CYCLE_OVERRUN]);
+        if(event == CYCLE_OK)
+        {
+            event = CYCLE_OVERRUN;
+        }
+    }
+
+    if( ok && !overrun )
+    {
+        if(_outputOverride != CYCLE_POLICY_NONE)
+        {
+            if(++_goodCycles >= _cycleRecovery)
+            {
+                _outputOverride = CYCLE_POLICY_NONE;
+            }
+        }
+        else if( (outputs != NULL) && ((_cyclePolicy[CYCLE_OVERRUN] == CYCLE_POLICY_HOLD_OUTPUTS) || 
+                 (_cyclePolicy[CYCLE_FRAME_LOST] == CYCLE_POLICY_HOLD_OUTPUTS) || (_cyclePolicy[CYCLE_WKC_LOW] == CYCLE_POLICY_HOLD_OUTPUTS)) )
+        {
+            // Keep the outputs of this good cycle for a later hold.
+            _holdOutputs.assign(outputs, outputs + size);
+        }
+    }
+
+    _lastCycleEvent = event;
+
+    if(_metrics != nullptr)
+    {
+        _metrics->countCycle(event, interval, exchange_us, wkc, _expectedWKC);
+    }
+
+    // The mailbox frame followed the process data frame. On a broken line it would only wait for its timeout.
+    if(_mailbox != nullptr)
+    {
+        _mailbox->service(_cycleStats.cycles, wkc != EC_NOFRAME);
+    }
+
+    if(_faultWindow > 0)
+    {
+        _countPageFaults();
+    }
+
+    if(_trace != nullptr)
+    {
+        _trace->record(TRACE_CYCLE_END, 0, event, wkc);
+        // Keep the events that led to the first failed cycle.
+        if(_cycleStats.consecutiveErrors == 1)
+        {
+            _trace->trigger();
+        }
+    }
+
+    return ok ? TRUE : FALSE;
+}
+
+void SimpleEthercat::setCycleDeadline(uint32_t cycle_us, uint32_t jitter_us)
+{
+    _cycleTimeUs = cycle_us;
+    _cycleJitterUs = jitter_us;
+    _lastCycleStartValid = false;
+}
+
+void SimpleEthercat::setCyclePolicy(EcCycleEvent event, EcCyclePolicy policy)
+{
+    if( (event != CYCLE_OVERRUN) && (event != CYCLE_FRAME_LOST) && (event != CYCLE_WKC_LOW) )
+    {
+        return;
+    }
+
+    _cyclePolicy[event] = policy;
+
+    // Allocate here so the cyclic path does not.
+    if(policy == CYCLE_POLICY_HOLD_OUTPUTS)
+    {
+        _holdOutputs.reserve(ec_group[0].Obytes);
+    }
+    if( (policy == CYCLE_POLICY_HOLD_OUTPUTS) || (policy == CYCLE_POLICY_SAFE_OUTPUTS) )
+    {
+        _appOutputs.reserve(ec_group[0].Obytes);
+    }
+}
+
+bool SimpleEthercat::setSafeOutputImage(const uint8_t *data, uint32_t size)
+{
+    if( (data == NULL) || (size != ec_group[0].Obytes) )
+    {
+        errorMessage = "SimpleEthercat error: safe output image size must be the output size of group 0.";
+        return false;
+    }
+
+    _safeOutputs.assign(data, data + size);
+
+    return true;
+}
+
+uint32_t SimpleEthercat::getSlaveCycleErrors(uint16_t slave_id)
+{
+    if(slave_id >= _slaveCycleErrors.size())
+    {
+        return 0;
+    }
+
+    return _slaveCycleErrors[slave_id];
+}
+
+bool SimpleEthercat::prepareRealtime(uint32_t stack_bytes)
+{
+    bool ok = _lockMemory();
+
+    _prefaultStack(stack_bytes);
+
+    // Touch every page of the IOmap without changing its content.
+    long page = sysconf(_SC_PAGESIZE);
+    volatile char *iomap = _IOmap;
+    for(size_t i = 0; i < sizeof(_IOmap); i += page)
+    {
+        iomap[i] = iomap[i];
+    }
+    iomap[sizeof(_IOmap) - 1] = iomap[sizeof(_IOmap) - 1];
+
+    // Buffers the cyclic path fills, allocated for the current mapping and settings.
+    uint32_t size = ec_group[0].Obytes;
+    _holdOutputs.reserve(size);
+    _appOutputs.reserve(size);
+    if(_outputTrackingEnable)
+    {
+        _outputShadow.reserve(size);
+        _outputDirtyRanges.reserve(size / 2 + 1);
+    }
+    _wkcFaults.reserve(_wkcDatagrams.size());
+    if(_slaveCycleErrors.size() < EC_MAXSLAVE)
+    {
+        _slaveCycleErrors.assign(EC_MAXSLAVE, 0);
+    }
+
+    // The first page fault window starts here, in the cyclic thread.
+    _faultBaseValid = _readPageFaults(_faultMinorBase, _faultMajorBase);
+    _faultWindowCycles = 0;
+
+    return ok;
+}
+
+void SimpleEthercat::setPageFaultWindow(uint32_t window_cycles)
+{
+    _faultWindow = window_cycles;
+    _faultWindowCycles = 0;
+    // The counters are per thread, the first window only reads them in the cyclic thread.
+    _faultBaseValid = false;
+}
+
+bool SimpleEthercat::_lockMemory(void)
+{
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        _setError(std::string("SimpleEthercat error: mlockall() failed: ") + strerror(errno) + ".");
+        return false;
+    }
+
+    // Never give freed heap memory back and never serve large blocks by mmap(), so malloc() and free() do not fault.
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    return true;
+}
+
+__attribute__((noinline)) void SimpleEthercat::_prefaultStack(uint32_t bytes)
+{
+    // The pages stay mapped, and locked, after the stack shrinks again.
+    volatile uint8_t *stack = (volatile uint8_t*)alloca(bytes);
+    long page = sysconf(_SC_PAGESIZE);
+
+    for(uint32_t i = 0; i < bytes; i += page)
+    {
+        stack[i] = 0;
+    }
+}
+
+bool SimpleEthercat::_readPageFaults(uint64_t &minor, uint64_t &major)
+{
+    struct rusage usage;
+
+    if(getrusage(RUSAGE_THREAD, &usage) != 0)
+    {
+        return false;
+    }
+
+    minor = usage.ru_minflt;
+    major = usage.ru_majflt;
+
+    return true;
+}
+
+void SimpleEthercat::_countPageFaults(void)
+{
+    if(++_faultWindowCycles < _faultWindow)
+    {
+        return;
+    }
+    _faultWindowCycles = 0;
+
+    uint64_t minor, major;
+    if(!_readPageFaults(minor, major))
+    {
+        return;
+    }
+
+    if(_faultBaseValid)
+    {
+        uint64_t faults = (minor - _faultMinorBase) + (major - _faultMajorBase);
+
+        _cycleStats.minorFaults += minor - _faultMinorBase;
+        _cycleStats.majorFaults += major - _faultMajorBase;
+        if(faults > 0)
+        {
+            _cycleStats.faultWindows++;
+            if(faults > _cycleStats.maxWindowFaults)
+            {
+                _cycleStats.maxWindowFaults = (uint32_t)faults;
+            }
+        }
+    }
+
+    _faultMinorBase = minor;
+    _faultMajorBase = major;
+    _faultBaseValid = true;
+}
+
+void SimpleEthercat::resetCycleStats(void)
+{
+    _cycleStats = EcCycleStats();
+    // Room for all slaves, so slaves added by checkTopology() never resize it while the cyclic thread reads.
+    _slaveCycleErrors.assign(EC_MAXSLAVE, 0);
+}
+
+int SimpleEthercat::_exchange(void)
+{
+    bool hotplug = _hotplugActive.load(std::memory_order_acquire);
+
+    if(_wkcDiagEnable)
+    {
+        int wkc = _exchangeDiagnostic();
+
+        // The hot-plug group is not part of the diagnostic datagrams, exchange it in its own frame.
+        if(hotplug)
+        {
+            ec_send_processdata_group(_HOTPLUG_GROUP);
+            int hotplug_wkc = ec_receive_processdata_group(_HOTPLUG_GROUP, EC_TIMEOUTRET);
+            wkc = ( (wkc == EC_NOFRAME) || (hotplug_wkc == EC_NOFRAME) ) ? EC_NOFRAME : wkc + hotplug_wkc;
+        }
+
+        if(_stateCacheEnable)
+        {
+            _receiveStateRead(wkc != EC_NOFRAME);
+        }
+
+        if(_trace != nullptr)
+        {
+            _trace->record(TRACE_RECEIVE, 0, 0, wkc);
+        }
+
+        return wkc;
+    }
+
+    ec_send_processdata();
+
+    // The receive below collects the frames of both groups and adds their working counters.
+    if(hotplug)
+    {
+        ec_send_processdata_group(_HOTPLUG_GROUP);
+    }
+
+    if(_stateCacheEnable)
+    {
+        _sendStateRead();
+    }
+
+    if(_mailbox != nullptr)
+    {
+        _mailbox->queue();
+    }
+
+    if(_trace != nullptr)
+    {
+        _trace->record(TRACE_SEND);
+    }
+
+    // Keep the frame indices for the per port statistics, the receive clears the index stack.
+    _cycleIdxCount = ecx_context.idxstack->pushed;
+    memcpy(_cycleIdx, ecx_context.idxstack->idx, _cycleIdxCount);
+
+    int wkc = ec_receive_processdata(EC_TIMEOUTRET);
+
+    // On a broken line the state frame would only wait for its timeout too.
+    if(_stateCacheEnable)
+    {
+        _receiveStateRead(wkc != EC_NOFRAME);
+    }
+
+    if(_trace != nullptr)
+    {
+        _trace->record(TRACE_RECEIVE, 0, 0, wkc);
+    }
+
+    return wkc;
+}
+
+void SimpleEthercat::_sendStateRead(void)
+{
+    /*
+    ec_send_processdata() builds its frames inside SOEM, so the BRD can not be added to them. It goes in a 
+    small frame of its own right behind them. The receive of the process data stores it when it arrives, 
+    so it costs no extra round trip.
+    */
+    uint16 al = 0;
+    _stateIdx = ec_getindex();
+    ec_setupdatagram(&ecx_context.port->txbuf[_stateIdx], EC_CMD_BRD, _stateIdx, 0, ECT_REG_ALSTAT, sizeof(al), &al);
+    ec_outframe_red(_stateIdx);
+}
+
+void SimpleEthercat::_receiveStateRead(bool wait)
+{
+    int wkc = wait ? ec_waitinframe(_stateIdx, EC_TIMEOUTRET) : EC_NOFRAME;
+
+    if(wkc > EC_NOFRAME)
+    {
+        uint16 al;
+        memcpy(&al, ecx_context.port->rxbuf[_stateIdx] + EC_HEADERSIZE, sizeof(al));
+
+        uint32_t line = ((uint32_t)wkc << 16) | etohs(al);
+        _lineStatus.store(line, std::memory_order_relaxed);
+        _lineStatusTimeNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(), 
+                                std::memory_order_release);
+
+        // A slave left OP or does not answer, let the error check thread find it.
+        if( (_state == EC_STATE_OPERATIONAL) && (line != (((uint32_t)ec_slavecount << 16) | EC_STATE_OPERATIONAL)) )
+        {
+            ec_group[_currentgroup].docheckstate = TRUE;
+        }
+    }
+
+    ec_setbufstat(_stateIdx, EC_BUF_EMPTY);
+}
+
+bool SimpleEthercat::setWkcDiagnostics(bool flag, uint16_t slaves_per_datagram)
+{
+    _wkcDiagEnable = false;
+    _wkcDatagrams.clear();
+    _wkcFaults.clear();
+    _wkcFrameCount = 0;
+
+    if(!flag)
+    {
+        return true;
+    }
+
+    if(slaves_per_datagram < 1)
+    {
+        slaves_per_datagram = 1;
+    }
+
+    if( !_planWkcDatagrams(true, slaves_per_datagram) || !_planWkcDatagrams(false, slaves_per_datagram) )
+    {
+        _wkcDatagrams.clear();
+        return false;
+    }
+
+    if(_wkcDatagrams.empty())
+    {
+        errorMessage = "SimpleEthercat error: no process data mapped for working counter diagnostics.";
+        return false;
+    }
+
+    // Pack the datagrams into frames. Frame 0 keeps room for the distributed clock datagram.
+    const int frame_size = EC_MAXECATFRAME - ETH_HEADERSIZE - EC_ELENGTHSIZE - 4;
+    int used = ec_group[0].hasdc ? EC_FIRSTDCDATAGRAM : 0;
+    uint8 frame = 0;
+
+    for(_WkcDatagram &datagram : _wkcDatagrams)
+    {
+        int size = EC_HEADERSIZE - EC_ELENGTHSIZE + datagram.length + EC_WKCSIZE;
+        if(used + size > frame_size)
+        {
+            frame++;
+            used = 0;
+        }
+        if(frame >= _WKC_MAX_FRAMES)
+        {
+            _wkcDatagrams.clear();
+            errorMessage = "SimpleEthercat error: process data is too large for working counter diagnostics.";
+            return false;
+        }
+        datagram.frame = frame;
+        used += size;
+    }
+
+    _wkcFrameCount = frame + 1;
+    // Allocate here so the cyclic path does not.
+    _wkcFaults.reserve(_wkcDatagrams.size());
+    _wkcDiagEnable = true;
+
+    return true;
+}
+
+bool SimpleEthercat::_planWkcDatagrams(bool outputs, uint16_t slaves_per_datagram)
+{
+    const int max_length = EC_MAXLRWDATA;
+    uint8 *base = (uint8*)_IOmap;
+    _WkcDatagram *current = nullptr;
+    uint16_t slaves = 0;
+
+    for(int slave = 1; slave <= ec_slavecount; slave++)
+    {
+        uint8 *data = outputs ? ec_slave[slave].outputs : ec_slave[slave].inputs;
+        uint32 bits = outputs ? ec_slave[slave].Obits : ec_slave[slave].Ibits;
+        uint32 start_bit = outputs ? ec_slave[slave].Ostartbit : ec_slave[slave].Istartbit;
+
+        if( (data == NULL) || (bits == 0) || (ec_slave[slave].group != 0) )
+        {
+            continue;
+        }
+
+        // Slaves below 8 bits have Obytes/Ibytes of zero, use the bit size.
+        uint32 offset = (uint32)(data - base);
+        uint32 end = offset + (start_bit + bits + 7) / 8;
+
+        if(current != nullptr)
+        {
+            uint32 current_start = current->logicalAddress - ec_group[0].logstartaddr;
+            uint32 current_end = current_start + current->length;
+            bool shared = (offset < current_end);
+
+            if( shared || ((slaves < slaves_per_datagram) && (end - current_start <= (uint32)max_length)) )
+            {
+                if( shared && (end - current_start > (uint32)max_length) )
+                {
+                    errorMessage = "SimpleEthercat error: process data is too large for working counter diagnostics.";
+                    return false;
+                }
+                if(end > current_end)
+                {
+                    current->length = (uint16)(end - current_start);
+                }
+                current->lastSlave = slave;
+                current->expected++;
+                slaves++;
+                continue;
+            }
+        }
+
+        if(end - offset > (uint32)max_length)
+        {
+            errorMessage = "SimpleEthercat error: process data of slave " + std::to_string(slave) + " is too large for working counter diagnostics.";
+            return false;
+        }
+
+        _WkcDatagram datagram;
+        datagram.command = outputs ? EC_CMD_LWR : EC_CMD_LRD;
+        datagram.logicalAddress = ec_group[0].logstartaddr + offset;
+        datagram.length = (uint16)(end - offset);
+        datagram.data = data;
+        datagram.firstSlave = slave;
+        datagram.lastSlave = slave;
+        datagram.expected = 1;
+        datagram.frame = 0;
+        datagram.rxOffset = 0;
+        _wkcDatagrams.push_back(datagram);
+        current = &_wkcDatagrams.back();
+        slaves = 1;
+    }
+
+    return true;
+}
+
+int SimpleEthercat::_exchangeDiagnostic(void)
+{
+    const size_t count = _wkcDatagrams.size();
+    const bool hasdc = ec_group[0].hasdc;
+    uint8 idx[_WKC_MAX_FRAMES];
+    uint16 dc_offset = 0;
+    size_t i = 0;
+
+    for(uint8 frame = 0; frame < _wkcFrameCount; frame++)
+    {
+        idx[frame] = ec_getindex();
+        _cycleIdx[frame] = idx[frame];
+        void *buffer = &ecx_context.port->txbuf[idx[frame]];
+        bool first = true;
+
+        for(; (i < count) && (_wkcDatagrams[i].frame == frame); i++)
+        {
+            _WkcDatagram &datagram = _wkcDatagrams[i];
+            uint16 adp = (uint16)(datagram.logicalAddress & 0xFFFF);
+            uint16 ado = (uint16)(datagram.logicalAddress >> 16);
+
+            if(first)
+            {
+                ec_setupdatagram(buffer, datagram.command, idx[frame], adp, ado, datagram.length, datagram.data);
+                datagram.rxOffset = EC_HEADERSIZE;
+                first = false;
+            }
+            else
+            {
+                bool more = ( (i + 1 < count) && (_wkcDatagrams[i + 1].frame == frame) ) || (hasdc && (frame == 0));
+                datagram.rxOffset = ec_adddatagram(buffer, datagram.command, idx[frame], more, adp, ado, datagram.length, datagram.data);
+            }
+        }
+
+        // Keep the distributed clock running like ec_send_processdata() does.
+        if(hasdc && (frame == 0))
+        {
+            dc_offset = ec_adddatagram(buffer, EC_CMD_FRMW, idx[frame], FALSE, ec_slave[ec_group[0].DCnext].configadr, 
+                                       ECT_REG_DCSYSTIME, sizeof(int64), &ec_DCtime);
+        }
+
+        ec_outframe_red(idx[frame]);
+    }
+
+    if(_stateCacheEnable)
+    {
+        _sendStateRead();
+    }
+
+    if(_mailbox != nullptr)
+    {
+        _mailbox->queue();
+    }
+
+    if(_trace != nullptr)
+    {
+        _trace->record(TRACE_SEND);
+    }
+
+    _cycleIdxCount = _wkcFrameCount;
+    _wkcFaults.clear();
+    int total = 0;
+    bool lost = false;
+    i = 0;
+
+    for(uint8 frame = 0; frame < _wkcFrameCount; frame++)
+    {
+        int frame_wkc = ec_waitinframe(idx[frame], EC_TIMEOUTRET);
+        const uint8 *rx = ecx_context.port->rxbuf[idx[frame]];
+
+        for(; (i < count) && (_wkcDatagrams[i].frame == frame); i++)
+        {
+            const _WkcDatagram &datagram = _wkcDatagrams[i];
+            int wkc = EC_NOFRAME;
+
+            if(frame_wkc > EC_NOFRAME)
+            {
+                uint16 le_wkc;
+                memcpy(&le_wkc, rx + datagram.rxOffset + datagram.length, EC_WKCSIZE);
+                wkc = etohs(le_wkc);
+                if(datagram.command == EC_CMD_LRD)
+                {
+                    memcpy(datagram.data, rx + datagram.rxOffset, datagram.length);
+                }
+                // Outputs count twice in the working counter of an LRW.
+                total += (datagram.command == EC_CMD_LWR) ? 2 * wkc : wkc;
+            }
+            else
+            {
+                lost = true;
+            }
+
+            if(wkc != datagram.expected)
+            {
+                _wkcFaults.push_back({datagram.firstSlave, datagram.lastSlave, datagram.command == EC_CMD_LWR, datagram.expected, wkc});
+            }
+        }
+
+        if( (frame_wkc > EC_NOFRAME) && hasdc && (frame == 0) )
+        {
+            int64 le_dctime;
+            memcpy(&le_dctime, rx + dc_offset, sizeof(le_dctime));
+            ec_DCtime = etohll(le_dctime);
+        }
+
+        ec_setbufstat(idx[frame], EC_BUF_EMPTY);
+    }
+
+    return lost ? EC_NOFRAME : total;
+}
+
+void SimpleEthercat::_updateRedundancyStats(bool ok, std::chrono::steady_clock::time_point cycle_start)
+{
+    ecx_portt *port = ecx_context.port;
+    bool closed = (_cycleIdxCount > 0);
+
+    /*
+    In redundancy mode SOEM sends each frame on the primary port and a dummy frame with the same index on the 
+    secondary port. The source address of a received frame tells which port sent it. With a closed ring each 
+    port receives the frame of the other port. With a break each port gets its own frame back.
+    rxsa is cleared after use, so a port that receives nothing next time is not counted from an old value.
+    */
+    for(uint8 k = 0; k < _cycleIdxCount; k++)
+    {
+        uint8 idx = _cycleIdx[k];
+        int primary = port->rxsa[idx];
+        int secondary = port->redport->rxsa[idx];
+
+        if(primary != 0)
+        {
+            _redundancyStats.primaryFrames++;
+        }
+        if(secondary != 0)
+        {
+            _redundancyStats.secondaryFrames++;
+        }
+
+        closed &= ( (primary == secMAC[1]) && (secondary == priMAC[1]) );
+
+        port->rxsa[idx] = 0;
+        port->redport->rxsa[idx] = 0;
+    }
+
+    if(_redundancyStats.ringClosed && !closed)
+    {
+        _redundancyStats.ringBreaks++;
+        _failoverActive = true;
+        _failoverStart = cycle_start;
+        _failoverCycles = 0;
+    }
+    else if(!_redundancyStats.ringClosed && closed && (_redundancyStats.ringBreaks > 0))
+    {
+        _redundancyStats.ringRestores++;
+    }
+
+    _redundancyStats.ringClosed = closed;
+
+    if(_failoverActive)
+    {
+        if(ok)
+        {
+            uint32_t us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _failoverStart).count();
+            _redundancyStats.lastFailoverUs = us;
+            _redundancyStats.lastFailoverCycles = _failoverCycles;
+            if(us > _redundancyStats.maxFailoverUs)
+            {
+                _redundancyStats.maxFailoverUs = us;
+            }
+            _failoverActive = false;
+        }
+        else
+        {
+            _failoverCycles++;
+        }
+    }
+}
+
+void SimpleEthercat::_applyCyclePolicy(EcCyclePolicy policy)
+{
+    switch(policy)
+    {
+        case CYCLE_POLICY_SKIP_NEXT:
+            _skipNext = true;
+        break;
+        case CYCLE_POLICY_HOLD_OUTPUTS:
+            // Safe outputs have priority over held outputs.
+            if(_outputOverride != CYCLE_POLICY_SAFE_OUTPUTS)
+            {
+                _outputOverride = CYCLE_POLICY_HOLD_OUTPUTS;
+            }
+            _goodCycles = 0;
+        break;
+        case CYCLE_POLICY_SAFE_OUTPUTS:
+            _outputOverride = CYCLE_POLICY_SAFE_OUTPUTS;
+            _goodCycles = 0;
+        break;
+        default:
+        break;
+    }
+}
+
+void SimpleEthercat::_countSlaveCycleErrors(void)
+{
+    // Ask the supervision thread to check the slaves.
+    ec_group[0].docheckstate = TRUE;
+
+    for(int slave = 1; (slave <= ec_slavecount) && (slave < (int)_slaveCycleErrors.size()); slave++)
+    {
+        bool failed = false;
+
+        if(_wkcDiagEnable)
+        {
+            // The diagnostic datagrams tell exactly which slaves failed.
+            for(const EcWkcFault &fault : _wkcFaults)
+            {
+                failed |= ( (slave >= fault.firstSlave) && (slave <= fault.lastSlave) );
+            }
+        }
+        else
+        {
+            // A user thread or the error check thread may be refreshing the status table, do not wait for it.
+            failed = _slaveFailed[slave].load(std::memory_order_relaxed);
+        }
+
+        if(failed)
+        {
+            _slaveCycleErrors[slave]++;
+            if(_metrics != nullptr)
+            {
+                _metrics->countSlaveCycleError(slave);
+            }
+        }
+    }
+}
+
+void SimpleEthercat::_updateExpectedWKC(bool hotplug)
+{
+    int wkc = (ec_group[0].outputsWKC * 2) + ec_group[0].inputsWKC - _hotplugWkcLoss;
+
+    if(hotplug)
+    {
+        wkc += (ec_group[_HOTPLUG_GROUP].outputsWKC * 2) + ec_group[_HOTPLUG_GROUP].inputsWKC;
+    }
+
+    _expectedWKC = wkc;
+}
+
+void SimpleEthercat::_captureTopology(void)
+{
+    // Room for all slaves, so slaves added by checkTopology() never resize it.
+    _portStatus.assign(EC_MAXSLAVE, 0);
+
+    for(int slave = 1; slave <= ec_slavecount; slave++)
+    {
+        _readPortStatus(slave, _portStatus[slave]);
+    }
+
+    _topologyValid = true;
+}
+
+bool SimpleEthercat::_readPortStatus(uint16 slave, uint16_t &status)
+{
+    uint16 dlstat = 0;
+
+    if(ec_FPRD(ec_slave[slave].configadr, ECT_REG_DLSTAT, sizeof(dlstat), &dlstat, EC_TIMEOUTRET) <= 0)
+    {
+        return false;
+    }
+
+    // Bits 4..15 are link, loop and communication state of ports 0..3. The lower bits are PDI state.
+    status = etohs(dlstat) & 0xFFF0;
+
+    return true;
+}
+
+void SimpleEthercat::_readPdoMapping(uint16 slave)
+{
+    std::pmr::vector<EcPdoEntry> &mapping = _pdoMapping[slave];
+    _clearPdoMapping(slave);
+
+    if( (ec_slave[slave].Obits == 0) && (ec_slave[slave].Ibits == 0) )
+    {
+        return;
+    }
+
+    uint32_t bits = 0;
+
+    /*
+    The same sources as ec_config_map() uses: the communication types in 0x1C00 tell which sync managers 
+    hold outputs and inputs, 0x1C1x lists their PDOs. Sync managers 0 and 1 are the mailbox.
+    */
+    if(ec_slave[slave].mbx_proto & ECT_MBXPROT_COE)
+    {
+        uint8 sm_count = 0;
+        int size = sizeof(sm_count);
+
+        if( (_readSDO(slave, ECT_SDO_SMCOMMTYPE, 0x00, &size, &sm_count) > 0) && (sm_count > 2) )
+        {
+            uint8 type_add = 0;
+            uint32_t output_bits = 0;
+            uint32_t input_bits = 0;
+
+            for(uint8 sm = 2; (sm < sm_count) && (sm < EC_MAXSM); sm++)
+            {
+                uint8 type = 0;
+                size = sizeof(type);
+                if(_readSDO(slave, ECT_SDO_SMCOMMTYPE, sm + 1, &size, &type) <= 0)
+                {
+                    continue;
+                }
+
+                // Some slaves report type 2 for SM2, their types are 0 1 2 3 instead of 1 2 3 4.
+                if( (sm == 2) && (type == 2) )
+                {
+                    type_add = 1;
+                }
+                if(type != 0)
+                {
+                    type += type_add;
+                }
+
+                if(type == 3)
+                {
+                    output_bits += _readPdoAssign(slave, sm, true, output_bits);
+                }
+                else if(type == 4)
+                {
+                    input_bits += _readPdoAssign(slave, sm, false, input_bits);
+                }
+            }
+
+            bits = output_bits + input_bits;
+        }
+    }
+
+    // ec_config_map() takes the SII too if the slave has no PDO assignment objects.
+    if(bits == 0)
+    {
+        _clearPdoMapping(slave);
+        _readSiiPdo(slave, true);
+        _readSiiPdo(slave, false);
+    }
+
+    std::stable_sort(mapping.begin(), mapping.end(), [](const EcPdoEntry &a, const EcPdoEntry &b)
+    {
+        return a.output && !b.output;
+    });
+}
+
+uint32_t SimpleEthercat::_readPdoAssign(uint16 slave, uint8 sm, bool output, uint32_t bit_offset)
+{
+    uint16 assign = ECT_SDO_PDOASSIGN + sm;
+    uint16 count = 0;
+    int size = sizeof(count);
+    uint32_t bits = 0;
+
+    if(_readSDO(slave, assign, 0x00, &size, &count) <= 0)
+    {
+        return 0;
+    }
+    count = etohs(count);
+
+    for(int i = 1; i <= count; i++)
+    {
+        uint16 pdo = 0;
+        size = sizeof(pdo);
+        if(_readSDO(slave, assign, (uint8)i, &size, &pdo) <= 0)
+        {
+            continue;
+        }
+        pdo = etohs(pdo);
+        if(pdo == 0)
+        {
+            continue;
+        }
+
+        uint8 objects = 0;
+        size = sizeof(objects);
+        _readSDO(slave, pdo, 0x00, &size, &objects);
+
+        for(int j = 1; j <= objects; j++)
+        {
+            uint32 content = 0;
+            size = sizeof(content);
+            if(_readSDO(slave, pdo, (uint8)j, &size, &content) <= 0)
+            {
+                continue;
+            }
+            content = etohl(content);
+
+            // Mapping entry: index in bits 16..31, subindex in bits 8..15, bit length in bits 0..7.
+            EcPdoEntry entry;
+            entry.pdo = pdo;
+            entry.index = (uint16)(content >> 16);
+            entry.subindex = (uint8)(content >> 8);
+            entry.bitLength = (uint8)content;
+            entry.dataType = 0;
+            entry.syncManager = sm;
+            entry.output = output;
+            entry.name = "";
+
+            if( (entry.index != 0) && (ec_slave[slave].CoEdetails & ECT_COEDET_SDOINFO) )
+            {
+                const EcODEntry *description = _odCache.getEntry(slave, entry.index, entry.subindex);
+                if(description != nullptr)
+                {
+                    entry.dataType = description->dataType;
+                    entry.name = _pdoString(description->name.c_str());
+                }
+            }
+
+            _addPdoEntry(slave, entry, bit_offset + bits);
+            bits += entry.bitLength;
+        }
+    }
+
+    return bits;
+}
+
+uint32_t SimpleEthercat::_readSiiPdo(uint16 slave, bool output)
+{
+    uint8 eectl = ec_slave[slave].eep_pdi;
+    uint32_t bits = 0;
+    int16 start = ec_siifind(slave, ECT_SII_PDO + (output ? 1 : 0));
+
+    if(start > 0)
+    {
+        uint16 a = start;
+        // Length of the category in words.
+        uint16 length = ec_siigetbyte(slave, a) | (ec_siigetbyte(slave, a + 1) << 8);
+        uint16 c = 1;
+        char name[EC_MAXNAME + 1];
+        a += 2;
+
+        /*
+        Each PDO is a header of 8 bytes (index, number of entries, sync manager, synchronization, name, flags) 
+        followed by 8 bytes per entry (index, subindex, name, data type, bit length, flags).
+        */
+        do
+        {
+            uint16 pdo = ec_siigetbyte(slave, a) | (ec_siigetbyte(slave, a + 1) << 8);
+            uint8 objects = ec_siigetbyte(slave, a + 2);
+            uint8 sm = ec_siigetbyte(slave, a + 3);
+            a += 8;
+
+            for(int j = 0; j < objects; j++)
+            {
+                EcPdoEntry entry;
+                entry.pdo = pdo;
+                entry.index = ec_siigetbyte(slave, a) | (ec_siigetbyte(slave, a + 1) << 8);
+                entry.subindex = ec_siigetbyte(slave, a + 2);
+                uint8 name_index = ec_siigetbyte(slave, a + 3);
+                entry.dataType = ec_siigetbyte(slave, a + 4);
+                entry.bitLength = ec_siigetbyte(slave, a + 5);
+                entry.syncManager = sm;
+                entry.output = output;
+                entry.name = "";
+                a += 8;
+
+                // A PDO with sync manager 0xFF is not active and not in the process data.
+                if(sm >= EC_MAXSM)
+                {
+                    continue;
+                }
+
+                if(name_index != 0)
+                {
+                    name[0] = 0;
+                    ec_siistring(name, slave, name_index);
+                    entry.name = _pdoString(name);
+                }
+
+                _addPdoEntry(slave, entry, bits);
+                bits += entry.bitLength;
+            }
+
+            c += 4 + 4 * objects;
+        }
+        while(c < length);
+    }
+
+    // Give the EEPROM back to the slave if it had it before.
+    if(eectl)
+    {
+        ec_eeprom2pdi(slave);
+    }
+
+    return bits;
+}
+
+void SimpleEthercat::_addPdoEntry(uint16 slave, EcPdoEntry &entry, uint32_t bit_offset)
+{
+    uint8 *start = entry.output ? ec_slave[slave].outputs : ec_slave[slave].inputs;
+
+    // Filler entries (0x0000:0x00) only take room.
+    if( ((entry.index == 0) && (entry.subindex == 0)) || (start == nullptr) )
+    {
+        return;
+    }
+
+    uint32_t bit = (entry.output ? ec_slave[slave].Ostartbit : ec_slave[slave].Istartbit) + bit_offset;
+    entry.byteOffset = (uint32_t)(start - (uint8*)_IOmap) + bit / 8;
+    entry.bitOffset = bit % 8;
+
+    _pdoMapping[slave].push_back(entry);
+}
+
+const char* SimpleEthercat::_pdoString(const char *text)
+{
+    size_t size = strlen(text) + 1;
+    if(size == 1)
+    {
+        return "";
+    }
+
+    char *str = (char*)_pdoPool.allocate(size, 1);
+    memcpy(str, text, size);
+
+    return str;
+}
+
+void SimpleEthercat::_clearPdoMapping(uint16 slave)
+{
+    std::pmr::vector<EcPdoEntry> &mapping = _pdoMapping[slave];
+
+    // Empty names are the literal "", they are not from the pool.
+    for(const EcPdoEntry &entry : mapping)
+    {
+        if(entry.name[0] != 0)
+        {
+            _pdoPool.deallocate((void*)entry.name, strlen(entry.name) + 1, 1);
+        }
+    }
+
+    // The capacity is kept for the next read of the same slave.
+    mapping.clear();
+}
+
+void SimpleEthercat::_addTopologyChange(uint16 slave, EcTopologyEvent event)
+{
+    if(_metrics != nullptr)
+    {
+        _metrics->countTopologyChange(event);
+    }
+
+    if(_trace != nullptr)
+    {
+        _trace->record(TRACE_TOPOLOGY, slave, event);
+    }
+
+    std::lock_guard<std::mutex> lock(_topologyMutex);
+    _topologyChanges.push_back({slave, event, ec_slave[slave].eep_man, ec_slave[slave].eep_id});
+}
+
+void SimpleEthercat::_recoveryAction(uint16 slave, EcRecoveryAction action)
+{
+    if(_metrics != nullptr)
+    {
+        _metrics->countRecovery(action);
+    }
+
+    if(_trace != nullptr)
+    {
+        _trace->record(TRACE_RECOVERY, slave, action);
+        if(action == RECOVERY_LOST)
+        {
+            _trace->trigger();
+        }
+    }
+}
+
+int SimpleEthercat::_readLineState(uint16 &state)
+{
+    uint16 al = 0;
+    int wkc = ec_BRD(0, ECT_REG_ALSTAT, sizeof(al), &al, EC_TIMEOUTRET);
+
+    // Like ec_statecheck(), the error flag is not part of the state.
+    state = etohs(al) & 0x0F;
+
+    return wkc;
+}
+
+bool SimpleEthercat::_requestState(uint16 state, uint32_t timeout_us, bool exchange)
+{
+    uint16 line;
+    if( (ec_slavecount > 0) && (_readLineState(line) >= ec_slavecount) && (line == state) )
+    {
+        ec_slave[0].state = state;
+        _startupTiming.skippedRequests++;
+        return true;
+    }
+
+    if(exchange)
+    {
+        ec_send_processdata();
+        ec_receive_processdata(EC_TIMEOUTRET);
+    }
+
+    ec_slave[0].state = state;
+    ec_writestate(0);
+
+    return _waitState(state, timeout_us);
+}
+
+bool SimpleEthercat::_waitState(uint16 state, uint32_t timeout_us)
+{
+    /*
+    ec_statecheck() sleeps 1 ms between two reads, which is longer than most transitions take. 
+    A short first sleep that doubles up to _STATE_POLL_MAX_US finds fast slaves early 
+    without loading the line while slow slaves load their configuration.
+    */
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint32_t sleep_us = _STATE_POLL_MIN_US;
+    uint16 line;
+
+    while(true)
+    {
+        if( (_readLineState(line) >= ec_slavecount) && (line == state) )
+        {
+            ec_slave[0].state = state;
+            return true;
+        }
+
+        uint32_t elapsed_us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        if(elapsed_us >= timeout_us)
+        {
+            break;
+        }
+
+        osal_usleep( (sleep_us < timeout_us - elapsed_us) ? sleep_us : timeout_us - elapsed_us );
+
+        sleep_us *= 2;
+        if(sleep_us > _STATE_POLL_MAX_US)
+        {
+            sleep_us = _STATE_POLL_MAX_US;
+        }
+    }
+
+    // update read states of slaves for the error messages.
+    _readStates();
+
+    return false;
+}
+
+void SimpleEthercat::_stateResult(uint16 state, bool ok)
+{
+    if(_metrics != nullptr)
+    {
+        _metrics->countStateTransition(state, ok);
+    }
+
+    if(_trace != nullptr)
+    {
+        _trace->record(TRACE_STATE, 0, (uint8_t)state, ok ? 1 : 0);
+    }
+}
+
+std::chrono::steady_clock::time_point SimpleEthercat::_sdoBegin(uint16 slave, uint16 index, uint8 subindex, bool write)
+{
+    if(_trace != nullptr)
+    {
+        _trace->record(TRACE_SDO_BEGIN, slave, write ? 1 : 0, ((int32_t)index << 8) | subindex);
+    }
+
+    return std::chrono::steady_clock::now();
+}
+
+void SimpleEthercat::_sdoEnd(uint16 slave, bool write, std::chrono::steady_clock::time_point start, int wkc)
+{
+    if(_metrics != nullptr)
+    {
+        uint32_t us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        _metrics->observeSdo(write, us, wkc > 0);
+    }
+
+    if(_trace != nullptr)
+    {
+        _trace->record(TRACE_SDO_END, slave, write ? 1 : 0, wkc);
+    }
+}
+
+std::vector<EcTopologyChange> SimpleEthercat::getTopologyChanges(void)
+{
+    std::vector<EcTopologyChange> changes;
+
+    std::lock_guard<std::mutex> lock(_topologyMutex);
+    changes.swap(_topologyChanges);
+
+    return changes;
+}
+
+bool SimpleEthercat::checkTopology(void)
+{
+    if(!_topologyValid)
+    {
+        _setError("SimpleEthercat error: checkTopology() needs configMap() first.");
+        return false;
+    }
+
+    // Every slave on the line increments the working counter of a broadcast read.
+    uint16 type;
+    int count = ec_BRD(0x0000, ECT_REG_TYPE, sizeof(type), &type, EC_TIMEOUTSAFE);
+
+    if(count <= 0)
+    {
+        _setError("SimpleEthercat error: checkTopology() got no answer from the line.");
+        return false;
+    }
+
+    const int known = ec_slavecount;
+    bool ok = true;
+    bool remap = false;
+
+    for(int slave = 1; slave <= known; slave++)
+    {
+        uint16_t status;
+
+        if(_readPortStatus(slave, status))
+        {
+            if(status != _portStatus[slave])
+            {
+                _portStatus[slave] = status;
+                _addTopologyChange(slave, TOPO_PORT_CHANGED);
+            }
+            continue;
+        }
+
+        // The slave does not answer at its address. A device at its position that lost its address was power cycled or swapped.
+        if(ec_recover_slave(slave, EC_TIMEOUTMON))
+        {
+            // Same device, the SM and FMMU settings of the configuration apply again.
+            if(ec_reconfig_slave(slave, EC_TIMEOUTMON))
+            {
+                _invalidateSdoCache(slave);
+                ec_slave[slave].islost = FALSE;
+                _readPortStatus(slave, _portStatus[slave]);
+                if(_state == EC_STATE_OPERATIONAL)
+                {
+                    ec_slave[slave].state = EC_STATE_OPERATIONAL;
+                    ec_writestate(slave);
+                }
+                _addTopologyChange(slave, TOPO_SLAVE_RECOVERED);
+            }
+            else
+            {
+                _setError("SimpleEthercat error: slave " + std::to_string(slave) + " was found again but can not be reconfigured.");
+                _addTopologyChange(slave, TOPO_CONFIG_FAILED);
+                ok = false;
+            }
+            continue;
+        }
+
+        // ec_recover_slave() leaves another device without address.
+        uint16 address = 0xFFFF;
+        int wkc = ec_APRD((uint16)(1 - slave), ECT_REG_STADR, sizeof(address), &address, EC_TIMEOUTRET);
+
+        if( (wkc > 0) && (etohs(address) == 0) )
+        {
+            if(_hotplugReserve == 0)
+            {
+                _setError("SimpleEthercat error: slave " + std::to_string(slave) + " was changed, there is no hot-plug reserve to map it.");
+                _addTopologyChange(slave, TOPO_CONFIG_FAILED);
+                ok = false;
+                continue;
+            }
+
+            // The process data of the old device stays in the LRW of group 0 without anyone answering it.
+            uint8 group = ec_slave[slave].group;
+            int loss = ((ec_slave[slave].Obits > 0) ? 2 : 0) + ((ec_slave[slave].Ibits > 0) ? 1 : 0);
+
+            if(_configHotplugSlave(slave))
+            {
+                if(group == 0)
+                {
+                    _hotplugWkcLoss += loss;
+                    _updateExpectedWKC(_hotplugActive);
+                }
+                _readPortStatus(slave, _portStatus[slave]);
+                _addTopologyChange(slave, TOPO_SLAVE_CHANGED);
+                remap = true;
+            }
+            else
+            {
+                _addTopologyChange(slave, TOPO_CONFIG_FAILED);
+                ok = false;
+            }
+            continue;
+        }
+
+        if(!ec_slave[slave].islost)
+        {
+            ec_slave[slave].islost = TRUE;
+            ec_slave[slave].state = EC_STATE_NONE;
+            _addTopologyChange(slave, TOPO_SLAVE_LOST);
+        }
+    }
+
+    // New slaves at the end of the line.
+    for(int position = known + 1; position <= count; position++)
+    {
+        uint16 address = 0xFFFF;
+        int wkc = ec_APRD((uint16)(1 - position), ECT_REG_STADR, sizeof(address), &address, EC_TIMEOUTRET);
+
+        // A configured slave behind the new ones means they were inserted inside the line and positions have moved.
+        if( (wkc <= 0) || (etohs(address) != 0) || (_hotplugReserve == 0) || (position >= EC_MAXSLAVE) )
+        {
+            _setError("SimpleEthercat error: slave at position " + std::to_string(position) + 
+                      " can not be hot-plugged, configSlaves() and configMap() are needed.");
+            _addTopologyChange(position, TOPO_CONFIG_FAILED);
+            ok = false;
+            break;
+        }
+
+        if(!_configHotplugSlave(position))
+        {
+            _addTopologyChange(position, TOPO_CONFIG_FAILED);
+            ok = false;
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> cycle(_cycleMutex);
+            ec_slavecount = position;
+        }
+        _slaveCount = position;
+        if(_metrics != nullptr)
+        {
+            _metrics->setSlaveCount(_slaveCount);
+        }
+        _readPortStatus(position, _portStatus[position]);
+        _addTopologyChange(position, TOPO_SLAVE_ADDED);
+        remap = true;
+    }
+
+    if(remap && !_mapHotplugGroup())
+    {
+        for(int slave = 1; slave <= ec_slavecount; slave++)
+        {
+            if(ec_slave[slave].group == _HOTPLUG_GROUP)
+            {
+                _addTopologyChange(slave, TOPO_CONFIG_FAILED);
+            }
+        }
+        ok = false;
+    }
+
+    // Lost, recovered and added slaves.
+    std::lock_guard<std::mutex> lock(_statusMutex);
+    _refreshStatusTable();
+
+    return ok;
+}
+
+bool SimpleEthercat::_configHotplugSlave(uint16 slave)
+{
+    const uint16 position = (uint16)(1 - slave);
+
+    /*
+    The entry in ec_slave[] may be in use by other threads. SOEM functions work on the slave list of a context, 
+    so the slave is built in a list of its own, with its own SII cache, and published when it is complete.
+    */
+    std::unique_ptr<ec_slavet[]> list(new ec_slavet[slave + 1]());
+    std::unique_ptr<uint8[]> esibuf(new uint8[EC_MAXEEPBUF]());
+    std::unique_ptr<uint32[]> esimap(new uint32[EC_MAXEEPBITMAP]());
+    ecx_contextt context = ecx_context;
+    context.slavelist = list.get();
+    context.esibuf = esibuf.get();
+    context.esimap = esimap.get();
+    context.esislave = 0;
+
+    ec_slavet &s = list[slave];
+
+    // Same steps as ec_config_init() does for each slave. ec_config_init() itself can not be used, it resets the whole line.
+
+    s.Itype = etohs(ec_APRDw(position, ECT_REG_PDICTL, EC_TIMEOUTRET3));
+
+    if(ec_APWRw(position, ECT_REG_STADR, htoes(EC_NODEOFFSET + slave), EC_TIMEOUTRET3) <= 0)
+    {
+        _setError("SimpleEthercat error: can not set address of slave " + std::to_string(slave) + ".");
+        return false;
+    }
+
+    // Only the first slave of the line drops non EtherCAT frames.
+    ec_APWRw(position, ECT_REG_DLCTL, htoes((slave == 1) ? 1 : 0), EC_TIMEOUTRET3);
+
+    s.configadr = EC_NODEOFFSET + slave;
+
+    uint16 alias = 0;
+    uint16 estat = 0;
+    ec_FPRD(s.configadr, ECT_REG_ALIAS, sizeof(alias), &alias, EC_TIMEOUTRET3);
+    s.aliasadr = etohs(alias);
+    ec_FPRD(s.configadr, ECT_REG_EEPSTAT, sizeof(estat), &estat, EC_TIMEOUTRET3);
+    if(etohs(estat) & EC_ESTAT_R64)
+    {
+        s.eep_8byte = 1;
+    }
+
+    // Identity and mailbox from the SII.
+    s.eep_man = etohl(ecx_readeeprom(&context, slave, ECT_SII_MANUF, EC_TIMEOUTEEP));
+    s.eep_id = etohl(ecx_readeeprom(&context, slave, ECT_SII_ID, EC_TIMEOUTEEP));
+    s.eep_rev = etohl(ecx_readeeprom(&context, slave, ECT_SII_REV, EC_TIMEOUTEEP));
+
+    uint32 data = etohl(ecx_readeeprom(&context, slave, ECT_SII_RXMBXADR, EC_TIMEOUTEEP));
+    s.mbx_wo = (uint16)LO_WORD(data);
+    s.mbx_l = (uint16)HI_WORD(data);
+
+    if(s.mbx_l > 0)
+    {
+        data = etohl(ecx_readeeprom(&context, slave, ECT_SII_TXMBXADR, EC_TIMEOUTEEP));
+        s.mbx_ro = (uint16)LO_WORD(data);
+        s.mbx_rl = (uint16)HI_WORD(data);
+        if(s.mbx_rl == 0)
+        {
+            s.mbx_rl = s.mbx_l;
+        }
+        s.mbx_proto = (uint16)LO_WORD(etohl(ecx_readeeprom(&context, slave, ECT_SII_MBXPROTO, EC_TIMEOUTEEP)));
+
+        s.SMtype[0] = 1;
+        s.SMtype[1] = 2;
+        s.SMtype[2] = 3;
+        s.SMtype[3] = 4;
+        s.SM[0].StartAddr = htoes(s.mbx_wo);
+        s.SM[0].SMlength = htoes(s.mbx_l);
+        s.SM[0].SMflags = htoel(EC_DEFAULTMBXSM0);
+        s.SM[1].StartAddr = htoes(s.mbx_ro);
+        s.SM[1].SMlength = htoes(s.mbx_rl);
+        s.SM[1].SMflags = htoel(EC_DEFAULTMBXSM1);
+    }
+
+    int16 general = ecx_siifind(&context, slave, ECT_SII_GENERAL);
+    if(general > 0)
+    {
+        s.CoEdetails = ecx_siigetbyte(&context, slave, general + 0x07);
+        s.FoEdetails = ecx_siigetbyte(&context, slave, general + 0x08);
+        s.EoEdetails = ecx_siigetbyte(&context, slave, general + 0x09);
+        s.SoEdetails = ecx_siigetbyte(&context, slave, general + 0x0a);
+        if(ecx_siigetbyte(&context, slave, general + 0x0d) & 0x02)
+        {
+            s.blockLRW = 1;
+        }
+        s.Ebuscurrent = ecx_siigetbyte(&context, slave, general + 0x0e) + (ecx_siigetbyte(&context, slave, general + 0x0f) << 8);
+    }
+
+    if(ecx_siifind(&context, slave, ECT_SII_STRING) > 0)
+    {
+        ecx_siistring(&context, s.name, slave, 1);
+    }
+    else
+    {
+        snprintf(s.name, sizeof(s.name), "? M:%8.8x I:%8.8x", (unsigned int)s.eep_man, (unsigned int)s.eep_id);
+    }
+
+    // Sync managers and FMMU functions of the SII replace the defaults.
+    ec_eepromSMt sm;
+    if(ecx_siiSM(&context, slave, &sm))
+    {
+        uint16 n = 0;
+        do
+        {
+            s.SM[n].StartAddr = htoes(sm.PhStart);
+            s.SM[n].SMlength = htoes(sm.Plength);
+            s.SM[n].SMflags = htoel(sm.Creg + (sm.Activate << 16));
+            n++;
+        }
+        while( (n < EC_MAXSM) && ecx_siiSMnext(&context, slave, &sm, n) );
+    }
+
+    ec_eepromFMMUt fmmu;
+    if(ecx_siiFMMU(&context, slave, &fmmu))
+    {
+        if(fmmu.FMMU0 != 0xFF) s.FMMU0func = fmmu.FMMU0;
+        if(fmmu.FMMU1 != 0xFF) s.FMMU1func = fmmu.FMMU1;
+        if(fmmu.FMMU2 != 0xFF) s.FMMU2func = fmmu.FMMU2;
+        if(fmmu.FMMU3 != 0xFF) s.FMMU3func = fmmu.FMMU3;
+    }
+
+    // Mailbox sync managers, needed in PRE_OP.
+    if(s.mbx_l > 0)
+    {
+        ec_FPWR(s.configadr, ECT_REG_SM0, sizeof(ec_smt) * 2, &s.SM[0], EC_TIMEOUTRET3);
+    }
+
+    ecx_eeprom2pdi(&context, slave);
+    ec_FPWRw(s.configadr, ECT_REG_ALCTL, htoes(EC_STATE_PRE_OP | EC_STATE_ACK), EC_TIMEOUTRET3);
+
+    bool ok = (ecx_statecheck(&context, slave, EC_STATE_PRE_OP, EC_TIMEOUTSTATE) == EC_STATE_PRE_OP);
+    if(!ok)
+    {
+        s.islost = TRUE;
+        _setError("SimpleEthercat error: hot-plugged slave " + std::to_string(slave) + " can not switch to Pre Operational.");
+    }
+
+    s.group = _HOTPLUG_GROUP;
+
+    // Publish the slave between two cycles, updateProccess() and the mailbox scheduler read ec_slave[].
+    {
+        std::lock_guard<std::mutex> cycle(_cycleMutex);
+        ec_slave[slave] = s;
+    }
+
+    _invalidateSdoCache(slave);
+
+    return ok;
+}
+
+bool SimpleEthercat::_mapHotplugGroup(void)
+{
+    // Stop the exchange of the hot-plug group while it is remapped. Group 0 keeps running.
+    _updateExpectedWKC(false);
+    _hotplugActive.store(false, std::memory_order_release);
+
+    // Slaves mapped before get new sync manager and FMMU settings, so they go back to PRE_OP as well.
+    for(int slave = 1; slave <= ec_slavecount; slave++)
+    {
+        if( (ec_slave[slave].group == _HOTPLUG_GROUP) && !ec_slave[slave].islost && (ec_slave[slave].state != EC_STATE_PRE_OP) )
+        {
+            ec_slave[slave].state = EC_STATE_PRE_OP;
+            ec_writestate(slave);
+            ec_statecheck(slave, EC_STATE_PRE_OP, EC_TIMEOUTSTATE);
+        }
+    }
+
+    int size = ec_config_map_group(&_IOmap[_IOmapSize], _HOTPLUG_GROUP);
+
+    // Nothing was exchanged with the new mapping yet, so a mapping larger than the reserve did not write anything.
+    if( (size < 0) || ((uint32_t)size > _hotplugReserve) )
+    {
+        _setError("SimpleEthercat error: hot-plugged slaves need " + std::to_string(size) + " IOmap bytes, the reserve is " + 
+                  std::to_string(_hotplugReserve) + ".");
+        return false;
+    }
+
+    for(int slave = 1; slave <= ec_slavecount; slave++)
+    {
+        if( (ec_slave[slave].group == _HOTPLUG_GROUP) && !ec_slave[slave].islost )
+        {
+            // Read again by the next getPdoMapping().
+            std::lock_guard<std::mutex> lock(_pdoMutex);
+            _pdoMappingRead[slave] = false;
+        }
+    }
+
+    bool ok = true;
+
+    for(int slave = 1; slave <= ec_slavecount; slave++)
+    {
+        if( (ec_slave[slave].group == _HOTPLUG_GROUP) && !ec_slave[slave].islost )
+        {
+            ec_slave[slave].state = EC_STATE_SAFE_OP;
+            ec_writestate(slave);
+            if(ec_statecheck(slave, EC_STATE_SAFE_OP, EC_TIMEOUTSTATE) != EC_STATE_SAFE_OP)
+            {
+                _setError("SimpleEthercat error: hot-plugged slave " + std::to_string(slave) + " can not switch to Safe Operational.");
+                ok = false;
+            }
+        }
+    }
+
+    _hotplugActive.store(true, std::memory_order_release);
+    _updateExpectedWKC(true);
+
+    if(_state != EC_STATE_OPERATIONAL)
+    {
+        return ok;
+    }
+
+    // Process data of the group is exchanged now, so the slaves can go to OP.
+    for(int slave = 1; slave <= ec_slavecount; slave++)
+    {
+        if( (ec_slave[slave].group == _HOTPLUG_GROUP) && (ec_slave[slave].state == EC_STATE_SAFE_OP) )
+        {
+            ec_slave[slave].state = EC_STATE_OPERATIONAL;
+            ec_writestate(slave);
+            if(ec_statecheck(slave, EC_STATE_OPERATIONAL, EC_TIMEOUTSTATE) != EC_STATE_OPERATIONAL)
+            {
+                _setError("SimpleEthercat error: hot-plugged slave " + std::to_string(slave) + " can not switch to Operational.");
+                ok = false;
+            }
+        }
+    }
+
+    return ok;
 }
\ No newline at end of file
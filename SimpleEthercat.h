@@ -7,10 +7,284 @@
 #include <iostream>        // standard I/O operations
 #include "ethercat.h"
 #include <thread>
+#include <vector>
+#include <unordered_map>
+#include <type_traits>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <memory_resource>
+#include "EthercatODCache.h"
+
+// ###################################################################################
+// Data structures:
+
+// Range of bytes in the process image, offset is relative to the start of the image.
+struct EcByteRange
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+// Result of a typed SDO read. value is valid only if ok() is true.
+template <typename T>
+struct EcResult
+{
+    T value;
+
+    // Working counter of the mailbox transfer. Zero or negative if failed.
+    int wkc;
+
+    bool ok(void) const {return wkc > 0;}
+
+    explicit operator bool() const {return ok();}
+};
+
+// One entry of a batched SDO write.
+struct EcSdoWrite
+{
+    uint16_t index;
+    uint8_t subindex;
+
+    // Size of value in bytes, 1 to 8. Value is sent little endian.
+    uint8_t size;
+
+    uint64_t value;
+};
+
+// Classification of one updateProccess() call.
+enum EcCycleEvent : uint8_t
+{
+    CYCLE_OK = 0,
+    // The call came later than cycle time + jitter after the previous one, or the exchange took longer than the cycle time.
+    CYCLE_OVERRUN,
+    // No frame came back in time.
+    CYCLE_FRAME_LOST,
+    // The frame came back with a working counter lower than expected.
+    CYCLE_WKC_LOW,
+    // No exchange, the cycle was skipped by CYCLE_POLICY_SKIP_NEXT.
+    CYCLE_SKIPPED,
+    CYCLE_EVENT_NUM
+};
+
+// Reaction of updateProccess() to a cycle event.
+enum EcCyclePolicy : uint8_t
+{
+    // Only count the event.
+    CYCLE_POLICY_NONE = 0,
+    // Do not exchange process data in the next call, so a late thread can catch up.
+    CYCLE_POLICY_SKIP_NEXT,
+    // Repeat the exchange once in the same call.
+    CYCLE_POLICY_RESEND,
+    // Send the outputs of the last good cycle until the bus is healthy again.
+    CYCLE_POLICY_HOLD_OUTPUTS,
+    // Send the safe output image until the bus is healthy again.
+    CYCLE_POLICY_SAFE_OUTPUTS
+};
+
+// Counters of updateProccess() events since configMap() or resetCycleStats().
+struct EcCycleStats
+{
+    uint32_t cycles = 0;
+    uint32_t overruns = 0;
+    uint32_t lostFrames = 0;
+    uint32_t wkcErrors = 0;
+    uint32_t skipped = 0;
+    uint32_t resends = 0;
+
+    // Cycles sent with held or safe outputs.
+    uint32_t degradedCycles = 0;
+
+    // Current number of consecutive cycles with lost frame or low working counter.
+    uint32_t consecutiveErrors = 0;
+
+    // Longest send/receive time in microseconds.
+    uint32_t maxExchangeUs = 0;
+
+    // Page faults of the cyclic thread, counted per window of SimpleEthercat::setPageFaultWindow() cycles.
+    uint64_t minorFaults = 0;
+    uint64_t majorFaults = 0;
+
+    // Windows with at least one page fault, and the most page faults in one window.
+    uint32_t faultWindows = 0;
+    uint32_t maxWindowFaults = 0;
+};
+
+// Working counter mismatch of one diagnostic datagram, see SimpleEthercat::setWkcDiagnostics().
+struct EcWkcFault
+{
+    // Slaves covered by the datagram.
+    uint16_t firstSlave;
+    uint16_t lastSlave;
+
+    // True for the output datagram (LWR), false for the input datagram (LRD).
+    bool outputs;
+
+    uint16_t expected;
+
+    // Received working counter, EC_NOFRAME if the frame was lost.
+    int wkc;
+};
+
+// Frame and failover statistics of a redundant ring, see SimpleEthercat::initRedundant().
+struct EcRedundancyStats
+{
+    // Process data frames received on each port.
+    uint32_t primaryFrames = 0;
+    uint32_t secondaryFrames = 0;
+
+    // True if in the last cycle the frames of both ports went around the whole ring.
+    bool ringClosed = false;
+
+    // Number of times the ring opened (cable break) and closed again.
+    uint32_t ringBreaks = 0;
+    uint32_t ringRestores = 0;
+
+    // Time from the first cycle with open ring to the first cycle with full working counter again.
+    uint32_t lastFailoverUs = 0;
+    uint32_t maxFailoverUs = 0;
+
+    // Failed cycles during the last failover.
+    uint32_t lastFailoverCycles = 0;
+};
+
+// Time of the startup phases in microseconds, see SimpleEthercat::getStartupTiming().
+struct EcStartupTiming
+{
+    // Scan of the line by configSlaves() until all slaves are in PRE_OP.
+    uint32_t configSlavesUs = 0;
+    uint32_t configMapUs = 0;
+    uint32_t configDcUs = 0;
+    uint32_t safeOpUs = 0;
+    uint32_t opUs = 0;
+
+    // State requests that were not sent because all slaves were in the state already.
+    uint32_t skippedRequests = 0;
+};
+
+// Result of one slave for SimpleEthercat::transitionSlaves().
+struct EcTransitionResult
+{
+    uint16_t slave = 0;
+
+    // True if the slave reached the requested state.
+    bool ok = false;
+
+    // State of the slave at the end, with error flag.
+    uint16_t state = 0;
+
+    // AL status code of the slave at the end.
+    uint16_t alStatusCode = 0;
+
+    // Time from the first request until the slave was in the state, or until it was given up.
+    uint32_t timeUs = 0;
+
+    // Number of requests sent to the slave, at most retries + 1. 0 if it was in the state already.
+    uint16_t requests = 0;
+};
+
+// One object mapped into the process data, see SimpleEthercat::getPdoMapping().
+struct EcPdoEntry
+{
+    // PDO that holds the object, e.g. 0x1600 or 0x1A00.
+    uint16_t pdo;
+
+    uint16_t index;
+    uint8_t subindex;
+    uint8_t bitLength;
+
+    // CoE data type (ECT_UNSIGNED16, ...), 0 if the slave does not describe the object.
+    uint16_t dataType;
+
+    uint8_t syncManager;
+
+    // True for outputs (RxPDO), false for inputs (TxPDO).
+    bool output;
+
+    // Position in the IOmap: byte from the start of the IOmap and first bit in that byte.
+    uint32_t byteOffset;
+    uint8_t bitOffset;
+
+    // Name of the object, empty if unknown. Valid as long as the entry.
+    const char *name;
+};
+
+/*
+State of all slaves as a structure of arrays, index is slave number, see SimpleEthercat::getStatusTable().
+The fields of one kind lie next to each other, so a check over all slaves reads a few cache lines 
+instead of one large ec_slave[] entry per slave, and compares several slaves with one SIMD instruction.
+*/
+struct EcStatusTable
+{
+    // Number of valid entries after index 0, equal to ec_slavecount at the last refresh.
+    uint16_t count = 0;
+
+    // AL state including the error flag (EC_STATE_ERROR).
+    alignas(64) uint16_t state[EC_MAXSLAVE] = {};
+
+    // AL status code.
+    alignas(64) uint16_t alStatusCode[EC_MAXSLAVE] = {};
+
+    // Working counter the slave adds to the LRW of its group: 2 with outputs plus 1 with inputs.
+    alignas(64) uint8_t wkc[EC_MAXSLAVE] = {};
+
+    alignas(64) uint8_t group[EC_MAXSLAVE] = {};
+
+    // 1 if the error check thread marked the slave as lost.
+    alignas(64) uint8_t lost[EC_MAXSLAVE] = {};
+};
+
+// Change of the line found by SimpleEthercat::checkTopology().
+enum EcTopologyEvent : uint8_t
+{
+    // Link or loop state of a port of the slave changed.
+    TOPO_PORT_CHANGED = 0,
+    // The slave was power cycled or swapped with the same device and runs with its old configuration again.
+    TOPO_SLAVE_RECOVERED,
+    // Another device is at the position of the slave. It was configured and mapped into the hot-plug reserve.
+    TOPO_SLAVE_CHANGED,
+    // A new slave at the end of the line was configured and mapped into the hot-plug reserve.
+    TOPO_SLAVE_ADDED,
+    // The slave does not answer anymore.
+    TOPO_SLAVE_LOST,
+    // A changed or new slave could not be configured. See errorMessage.
+    TOPO_CONFIG_FAILED,
+    TOPO_EVENT_NUM
+};
+
+struct EcTopologyChange
+{
+    uint16_t slave;
+
+    EcTopologyEvent event;
+
+    // Identity of the slave after the change.
+    uint32_t manufacturer;
+    uint32_t product;
+};
+
+// Action of the error check thread on a slave.
+enum EcRecoveryAction : uint8_t
+{
+    // SAFE_OP + ERROR acknowledged.
+    RECOVERY_ACK = 0,
+    // SAFE_OP slave requested to OP again.
+    RECOVERY_TO_OP,
+    RECOVERY_RECONFIG,
+    RECOVERY_LOST,
+    RECOVERY_RECOVERED,
+    // A lost slave answered again without recovery.
+    RECOVERY_FOUND,
+    RECOVERY_ACTION_NUM
+};
 
 // ###################################################################################
 // SimpleEthercat class:
 
+class EthercatMetrics;
+class EthercatTrace;
+class EthercatMailbox;
+
 class SimpleEthercat
 {
 public:
@@ -21,11 +295,26 @@ public:
     /**
      * @brief Initial ethercat port.   
      * initialise SOEM, bind socket to port_name.   
-     * Start the thread_errorCheck.  
+     * The error check thread is started separately by startSupervision().  
      * @return true if successed.
      *  */  
     bool init(const char* port_name);
 
+    /**
+     * @brief Initialise SOEM in cable redundancy mode.
+     * The line is wired as a ring from primary_port over all slaves back to secondary_port. If the cable breaks 
+     * at one point, the slaves on both sides of the break are still reached from one port each and the process 
+     * data exchange continues. Use instead of init().
+     * @return true if successed.
+     */
+    bool initRedundant(const char* primary_port, const char* secondary_port);
+
+    // Return true if initialised by initRedundant().
+    bool isRedundant(void) {return _redundant;}
+
+    // Return frame and failover statistics of the redundant ring. Updated by updateProccess().
+    const EcRedundancyStats& getRedundancyStats(void) {return _redundancyStats;}
+
     /**
      * Find and auto-config slaves.
      * Set all slave operation state to Pre operational.
@@ -42,20 +331,220 @@ public:
      */ 
     bool configMap(void);
 
+    /**
+     * @brief Set number of IOmap bytes kept free for slaves that are hot-plugged later. Default is 0.
+     * Call before configMap(). Changed and added slaves found by checkTopology() are mapped into this area, 
+     * without a new configMap() of the whole line. Without a reserve checkTopology() only recovers slaves.
+     */
+    void setHotplugReserve(uint32_t bytes) {_hotplugReserve = bytes;}
+
+    /**
+     * @brief Check the line for changes and reconfigure only the slaves that changed.
+     * The number of slaves is counted with one broadcast read, the port state of each slave is compared with 
+     * the state found by configMap(). A slave that does not answer at its address anymore is recovered if the 
+     * same device is back at its position. Another device at its position and new slaves at the end of the line 
+     * are configured one by one and mapped together into the hot-plug reserve, as a second group that is 
+     * exchanged with the same updateProccess(). All other slaves keep exchanging process data meanwhile.
+     * @note Call after configMap() from the thread that supervises the slaves, or use setTopologyCheckPeriod() 
+     * with startSupervision().
+     * Hot-plugged slaves are mapped with their default PDO assignment and without distributed clock. 
+     * Call setWkcDiagnostics() again after a slave was changed or added.
+     * @return false if a frame was lost or a slave could not be configured.
+     */
+    bool checkTopology(void);
+
+    /**
+     * @brief Set period of checkTopology() calls from the error check thread. Zero disables them (default).
+     * The error check thread runs after startSupervision().
+     */
+    void setTopologyCheckPeriod(uint32_t period_ms) {_topologyCheckPeriodMs = period_ms;}
+
+    /**
+     * @brief Start the error check thread. It wakes up every 10 ms.
+     * While the master is in OP and a cycle failed or a slave is reported not operational, it acknowledges 
+     * slaves in SAFE_OP + ERROR, requests OP again, and reconfigures or recovers lost slaves. It also runs 
+     * checkTopology() every setTopologyCheckPeriod() and writes the trace of a fault (see EthercatTrace).
+     * @note Call after configMap(). The thread runs until stopSupervision() or close().
+     * @return false if it is running already.
+     */
+    bool startSupervision(void);
+
+    // Stop the error check thread and wait for it.
+    void stopSupervision(void);
+
+    // Return and clear the changes found by checkTopology() since the last call.
+    std::vector<EcTopologyChange> getTopologyChanges(void);
+
+    /**
+     * @brief Select byte aligned (default) or bit packed IOmap for next configMap().
+     * Without byte alignment slaves with less than 8 bits share bytes in the IOmap.
+     * Use EthercatDigitalBank from EthercatBitIO.h to access them in bulk.
+     */
+    void setForceByteAlignment(bool flag) {_forceByteAlignment = flag;}
+
     // set distrubution clock for all slaves. 
     bool configDc(void);
 
+    /*
+    SDO functions below may be called from several threads for different slaves, 
+    e.g. by EthercatStartupConfig. Their errorMessage is the last error of any of these threads.
+    */
+
     // Read proccess for SDO objects dictionary.
     int readSDO(uint16 slave_num, uint16 index, uint8 subindex, int size, void *buffer);
 
     // Write proccess for SDO objects dictionary.
     int writeSDO(uint16 slave_num, uint16 index, uint8 subindex, int size, void *buffer);
 
-    // Write proccess for SDO objects dictionary.
+    /**
+     * @brief Write proccess for SDO objects dictionary.
+     * Value is widened to size bytes (1 to 8) with zero upper bytes, so it can be written to wider objects.
+     */
     int writeSDO(uint16 slave_num, uint16 index, uint8 subindex, int size, uint8_t buffer);
 
+    /**
+     * @brief Read an SDO object as type T. Size of the transfer is sizeof(T).
+     * @return Value and working counter. Fails if the slave returns a different size.
+     */
+    template <typename T>
+    EcResult<T> readSDO(uint16 slave_num, uint16 index, uint8 subindex)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "readSDO<T> needs a trivially copyable type.");
+
+        EcResult<T> result{};
+        int size = sizeof(T);
+
+        if(!_checkSdoSize(slave_num, index, subindex, sizeof(T)))
+        {
+            return result;
+        }
+
+        result.wkc = _readSDO(slave_num, index, subindex, &size, &result.value);
+
+        if( (result.wkc > 0) && (size != (int)sizeof(T)) )
+        {
+            _setError("SimpleEthercat error: readSDO() returned " + std::to_string(size) + " bytes, expected " + std::to_string(sizeof(T)) + ".");
+            result.wkc = 0;
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Write an SDO object from type T. Size of the transfer is sizeof(T).
+     * @return Working counter, > 0 if successed.
+     */
+    template <typename T>
+    int writeSDO(uint16 slave_num, uint16 index, uint8 subindex, const T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "writeSDO<T> needs a trivially copyable type.");
+
+        if(!_checkSdoSize(slave_num, index, subindex, sizeof(T)))
+        {
+            return 0;
+        }
+
+        return writeSDO(slave_num, index, subindex, sizeof(T), (void*)&value);
+    }
+
+    /**
+     * @brief Write a table of SDO values to one slave.
+     * Consecutive entries of one object that write subindex 1..n followed by subindex 0 = n (the usual PDO 
+     * mapping sequence, an optional leading subindex 0 = 0 included) are sent as one complete access 
+     * transfer if the slave supports it. All other entries are written one by one, in table order.
+     * @return true if all entries are written. errorMessage names the first failed entry.
+     */
+    bool writeSDOs(uint16 slave_num, const EcSdoWrite *entries, size_t count);
+
+    /**
+     * @brief Enable or disable size checking of typed SDO access against the object dictionary. Disabled by default.
+     * The entry description is taken from getODCache(), so only the first access to an object asks the slave.
+     */
+    void setSdoTypeCheck(bool flag) {_sdoTypeCheck = flag;}
+
+    /**
+     * @brief Enable or disable the SDO write cache. Disabled by default.
+     * When enabled, writeSDO() remembers every successfully written value and skips the mailbox
+     * transfer if the same value is written again to the same object.
+     * Entries of a slave are dropped when it is reconfigured or recovered, and an entry is dropped when readSDO()
+     * returns a different value for the object.
+     * @warning Do not enable for objects that the slave changes by itself (command objects, counters).
+     */
+    void setSdoWriteCache(bool flag);
+
+    // Forget all cached SDO values. The next writeSDO() of every object goes to the bus.
+    void clearSdoWriteCache(void);
+
+    // Return number of writeSDO() calls that were skipped by the SDO write cache.
+    uint32_t getSdoWritesSkipped(void) {return _sdoWritesSkipped;}
+
+    /**
+     * @brief Enable or disable change tracking of the output process image. Disabled by default.
+     * When enabled, every updateProccess() compares the outputs of group 0 with the outputs sent in the previous 
+     * cycle and records the changed byte ranges. The first cycle after enabling reports the whole image.
+     */
+    void setOutputChangeTracking(bool flag);
+
+    /**
+     * @brief Return byte ranges of the output image that changed in the last updateProccess().
+     * Offsets are relative to the first output byte of group 0. Ranges are sorted and do not overlap.
+     * Recorders and exporters can copy only these ranges instead of the whole image.
+     */
+    const std::vector<EcByteRange>& getOutputDirtyRanges(void) {return _outputDirtyRanges;}
+
+    /**
+     * @brief Return the object dictionary cache of this master.
+     * Object descriptions are read from the slaves on first access and shared by slaves with the same identity.
+     */
+    EthercatODCache& getODCache(void) {return _odCache;}
+
+    /**
+     * @brief Attach a metrics registry, nullptr to detach. See EthercatMetrics.h.
+     * Call before the cyclic thread starts. The object must live as long as it is attached.
+     */
+    void setMetrics(EthercatMetrics *metrics) {_metrics = metrics;}
+
+    /**
+     * @brief Attach an event trace, nullptr to detach. See EthercatTrace.h.
+     * Call before the cyclic thread starts. The object must live as long as it is attached.
+     */
+    void setTrace(EthercatTrace *trace) {_trace = trace;}
+
+    /**
+     * @brief Attach a mailbox scheduler, nullptr to detach. See EthercatMailbox.h.
+     * updateProccess() sends the frame of one mailbox pass behind the process data and takes its results after 
+     * the exchange.
+     * Call before the cyclic thread starts. The object must live as long as it is attached.
+     */
+    void setMailbox(EthercatMailbox *mailbox) {_mailbox = mailbox;}
+
     // Return number of slaves that detected.
     int getSlaveCount(void) {return _slaveCount;};
+
+    /**
+     * @brief Return the objects mapped into the process data of a slave, outputs first, each in IOmap order.
+     * The mapping is read on the first call for a slave after configMap(): from the PDO assignment of CoE slaves, 
+     * or from the SII of the others. Names and data types of CoE objects are taken from getODCache() if the slave 
+     * has SDO information. Filler entries are left out. Empty for slaves without process data. The mapping of 
+     * a hot-plugged slave is read again after checkTopology() mapped it.
+     * @note The first call for a slave makes SDO transfers, do not call it from the cyclic thread.
+     * @param count is set to the number of entries.
+     * @return first entry, valid until the next configMap() or until the slave is hot-plugged again. 
+     * nullptr if count is 0.
+     */
+    const EcPdoEntry* getPdoMapping(uint16 slave_num, size_t &count);
+
+    /**
+     * @brief Return the mapping of an object of a slave.
+     * @return nullptr if the object is not in the process data.
+     */
+    const EcPdoEntry* findPdoEntry(uint16 slave_num, uint16 index, uint8 subindex);
+
+    /**
+     * @brief Return time of the last call of configSlaves(), configMap(), configDc(), setSafeOperationalState() 
+     * and setOperationalState(). Cleared by configSlaves().
+     */
+    const EcStartupTiming& getStartupTiming(void) {return _startupTiming;}
     
     // Set init state for all slaves.
     void setInitState(void);
@@ -66,6 +555,19 @@ public:
     // Set safe operational state for all slaves. 
     bool setSafeOperationalState(void);
 
+    /**
+     * @brief Request a state for all slaves and follow each slave separately.
+     * The state is requested with one broadcast write. A slave that is not in the state after slave_timeout_us, 
+     * or shows the error flag, is requested again on its own, with an error acknowledge if needed. 
+     * The other slaves are not written again. A slave is given up after retries repeated requests.
+     * @note The process data is not exchanged meanwhile, use setOperationalState() for OP.
+     * @return true if all slaves reached the state. See getTransitionResults() for each slave.
+     */
+    bool transitionSlaves(uint16 state, uint32_t slave_timeout_us = EC_TIMEOUTSTATE, uint8_t retries = 3);
+
+    // Return result of each slave of the last transitionSlaves(), index is slave number - 1.
+    const std::vector<EcTransitionResult>& getTransitionResults(void) {return _transitionResults;}
+
     /**
      * @brief Set operational state for all slaves.
      * @warning 
@@ -85,15 +587,123 @@ public:
     // Print current state slaves.
     void showStates(void);
 
-    // Send and recieve proccess data (PDO) in blocking mode.
+    /**
+     * @brief Send and recieve proccess data (PDO) in blocking mode.
+     * Every call is classified (see getLastCycleEvent()) and the policy of the event is applied.
+     * Held or safe outputs of a policy are sent instead of the output image, the image itself is not changed.
+     * @return false if the frame was lost or working counter was low and a resend did not fix it, 
+     * or if the cycle was skipped by CYCLE_POLICY_SKIP_NEXT and no data was exchanged.
+     */
     bool updateProccess(void);
 
+    /**
+     * @brief Set cycle time for overrun detection. Zero disables overrun detection (default).
+     * @param cycle_us is the period updateProccess() is called with.
+     * @param jitter_us is the allowed lateness of a call before it counts as overrun.
+     */
+    void setCycleDeadline(uint32_t cycle_us, uint32_t jitter_us);
+
+    /**
+     * @brief Set reaction to a cycle event. All events use CYCLE_POLICY_NONE by default.
+     * Only CYCLE_OVERRUN, CYCLE_FRAME_LOST and CYCLE_WKC_LOW have a policy.
+     */
+    void setCyclePolicy(EcCycleEvent event, EcCyclePolicy policy);
+
+    /**
+     * @brief Lock all memory of the process in RAM from init() or initRedundant() on, so the buffers that SOEM 
+     * allocates there are locked too. Disabled by default. See prepareRealtime().
+     */
+    void setMemoryLock(bool flag) {_memoryLock = flag;}
+
+    /**
+     * @brief Prepare the process and the calling thread for the cyclic exchange, so the first cycles do not page fault.
+     * Locks all current and future memory (mlockall), keeps freed heap memory in the process, touches stack_bytes 
+     * of the stack of the calling thread and every page of the IOmap, and allocates the buffers updateProccess() 
+     * needs for the current settings.
+     * @note Call from the thread that calls updateProccess(), after configMap() and the cycle settings, before OP.
+     * Locking needs CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK.
+     * @return false if memory could not be locked. The other steps are done anyway.
+     */
+    bool prepareRealtime(uint32_t stack_bytes = 256 * 1024);
+
+    /**
+     * @brief Count page faults of the cyclic thread every window_cycles calls of updateProccess(), see EcCycleStats.
+     * One getrusage() call per window. Zero disables counting (default).
+     */
+    void setPageFaultWindow(uint32_t window_cycles);
+
+    /**
+     * @brief Set number of good cycles after which held or safe outputs are released. Default is 1.
+     */
+    void setCycleRecovery(uint32_t good_cycles) {_cycleRecovery = (good_cycles < 1) ? 1 : good_cycles;}
+
+    /**
+     * @brief Set output image for CYCLE_POLICY_SAFE_OUTPUTS. Call after configMap().
+     * Without a safe image all outputs are sent as zero.
+     * @param size must be the output size of group 0.
+     * @return true if successed.
+     */
+    bool setSafeOutputImage(const uint8_t *data, uint32_t size);
+
+    // Return classification of the last updateProccess() call.
+    EcCycleEvent getLastCycleEvent(void) {return _lastCycleEvent;}
+
+    // Return true while held or safe outputs are sent instead of the application outputs.
+    bool isOutputDegraded(void) {return _outputOverride != CYCLE_POLICY_NONE;}
+
+    const EcCycleStats& getCycleStats(void) {return _cycleStats;}
+
+    /**
+     * @brief Return number of failed cycles in which slave_id was found not operational or lost.
+     * Slaves are located from the state known to the master, no extra bus traffic is made in the cycle.
+     * With setWkcDiagnostics() enabled, slaves are located by the working counters of their datagrams.
+     */
+    uint32_t getSlaveCycleErrors(uint16_t slave_id);
+
+    // Reset cycle statistics of the master and all slaves.
+    void resetCycleStats(void);
+
+    /**
+     * @brief Enable or disable per slave working counter diagnostics. Disabled by default.
+     * When enabled, updateProccess() replaces the LRW of group 0 by one LWR datagram for the outputs and one LRD
+     * datagram for the inputs of every segment of slaves, sent in the same frame(s), and checks the working counter
+     * of each datagram on its own. A missing slave is then located in the cycle it fails, and failed cycles are
+     * counted for exactly the slaves of the failed datagrams (see getSlaveCycleErrors()).
+     * Slaves that share process data bytes are always put in the same segment.
+     * @param slaves_per_datagram is the number of slaves in one segment, 1 for per slave diagnostics.
+     * @note Call after configMap(). A new configMap() disables the diagnostics.
+     * @return true if successed.
+     */
+    bool setWkcDiagnostics(bool flag, uint16_t slaves_per_datagram = 1);
+
+    // Return datagrams with a wrong working counter in the last updateProccess(). Empty if all matched.
+    const std::vector<EcWkcFault>& getWkcFaults(void) {return _wkcFaults;}
+
     // Return ethercat state for slave 1.
     int getState(void);
 
-    // Return certain slave ethercat state.
+    // Return certain slave ethercat state. EC_STATE_NONE for numbers after the last slave.
     int getState(uint16_t slave_id);
 
+    /**
+     * @brief Return a copy of the state of all slaves from the last state read, no bus traffic is made.
+     * Refreshed by getState(), showStates(), isAllStatesOPT(), listSlaves(), state changes and the error check thread.
+     */
+    EcStatusTable getStatusTable(void);
+
+    /**
+     * @brief Enable or disable the state cache. Disabled by default.
+     * When enabled, updateProccess() reads the AL status of all slaves with one broadcast read (BRD) that is sent 
+     * right behind the process data frame. As long as all slaves answer and are in the same state, getState(), 
+     * isAllStatesOPT(), showStates() and listSlaves() take the state from it without bus traffic. Only if the 
+     * broadcast shows different states, a missing slave or an error flag, the slaves are read one by one, 
+     * once for each new broadcast result. In OP the error check thread is then asked to check the slaves, 
+     * if it runs (see startSupervision()).
+     * @param max_age_us is the age of the broadcast result after which the getters read the slaves again, 
+     * e.g. when updateProccess() is not called anymore.
+     */
+    void setStateCache(bool flag, uint32_t max_age_us = 100000);
+
     // Return expectedWKC.
     int32_t getExpectedWKC(void) {return _expectedWKC;}
 
@@ -111,6 +721,8 @@ public:
 
     // Close ethercat port.
     void close(void);
+
+    ~SimpleEthercat() {stopSupervision();}
     
 private:
     /* This array represents the input/output (I/O) map used for EtherCAT communication. 
@@ -126,7 +738,9 @@ private:
     int _slaveCount;
 
     bool _forceByteAlignment = TRUE;
-    int _expectedWKC;
+
+    // Written by checkTopology() while updateProccess() reads it.
+    std::atomic<int> _expectedWKC{0};
 
     // Indicate current ethercat operational state of SimpleEthercat object.
     int _state = EC_STATE_NONE;
@@ -152,16 +766,391 @@ private:
     // thread for ethercat error handling.
     std::thread _thread_errorCheck;
 
+    // Ask the error check thread to end.
+    std::atomic<bool> _supervisionStop{false};
+
+    // Object dictionary descriptions of all slaves.
+    EthercatODCache _odCache;
+
+    // Cached SDO values written by writeSDO(). Key is built by _sdoCacheKey().
+    std::unordered_map<uint64_t, std::vector<uint8_t>> _sdoCache;
+
+    bool _sdoCacheEnable = false;
+
+    bool _sdoTypeCheck = false;
+
+    // Protect _sdoCache for SDO access from several threads.
+    std::mutex _sdoMutex;
+
+    // Protect errorMessage for functions that may run in several threads.
+    std::mutex _errorMutex;
+
+    uint32_t _sdoWritesSkipped = 0;
+
+    // Output image sent in the previous cycle, used for change tracking.
+    std::vector<uint8_t> _outputShadow;
+
+    std::vector<EcByteRange> _outputDirtyRanges;
+
+    bool _outputTrackingEnable = false;
+
+    // Indicate _outputShadow holds the outputs of the previous cycle.
+    bool _outputShadowValid = false;
+
+    uint32_t _cycleTimeUs = 0;
+    uint32_t _cycleJitterUs = 0;
+
+    EcCyclePolicy _cyclePolicy[CYCLE_EVENT_NUM] = {};
+
+    uint32_t _cycleRecovery = 1;
+
+    // Good cycles since the last error while outputs are degraded.
+    uint32_t _goodCycles = 0;
+
+    // CYCLE_POLICY_HOLD_OUTPUTS or CYCLE_POLICY_SAFE_OUTPUTS while outputs are overridden.
+    EcCyclePolicy _outputOverride = CYCLE_POLICY_NONE;
+
+    bool _skipNext = false;
+
+    EcCycleEvent _lastCycleEvent = CYCLE_OK;
+
+    EcCycleStats _cycleStats;
+
+    bool _memoryLock = false;
+
+    uint32_t _faultWindow = 0;
+    uint32_t _faultWindowCycles = 0;
+
+    // Page faults of the cyclic thread at the start of the window. Read in the cyclic thread, so only valid after the first window.
+    uint64_t _faultMinorBase = 0;
+    uint64_t _faultMajorBase = 0;
+    bool _faultBaseValid = false;
+
+    // Failed cycles of each slave, index is slave number.
+    std::vector<uint32_t> _slaveCycleErrors;
+
+    // Start time of the previous updateProccess() call.
+    std::chrono::steady_clock::time_point _lastCycleStart;
+
+    bool _lastCycleStartValid = false;
+
+    // Outputs of the last good cycle, kept when CYCLE_POLICY_HOLD_OUTPUTS is used.
+    std::vector<uint8_t> _holdOutputs;
+
+    std::vector<uint8_t> _safeOutputs;
+
+    // Application outputs, kept aside while held or safe outputs are exchanged.
+    std::vector<uint8_t> _appOutputs;
+
+    // One datagram of the per slave working counter diagnostics.
+    struct _WkcDatagram
+    {
+        // EC_CMD_LWR or EC_CMD_LRD.
+        uint8 command;
+        uint32 logicalAddress;
+        uint16 length;
+
+        // Process data in the IOmap.
+        uint8 *data;
+
+        uint16 firstSlave;
+        uint16 lastSlave;
+        uint16 expected;
+
+        // Frame number of the datagram in one cycle.
+        uint8 frame;
+
+        // Offset of the datagram data in the received frame.
+        uint16 rxOffset;
+    };
+
+    // Maximum number of frames per cycle in diagnostic mode.
+    static const uint8 _WKC_MAX_FRAMES = 4;
+
+    bool _wkcDiagEnable = false;
+
+    std::vector<_WkcDatagram> _wkcDatagrams;
+
+    uint8 _wkcFrameCount = 0;
+
+    std::vector<EcWkcFault> _wkcFaults;
+
+    bool _redundant = false;
+
+    EcRedundancyStats _redundancyStats;
+
+    // Frame indices used by the last exchange.
+    uint8 _cycleIdx[EC_MAXBUF];
+    uint8 _cycleIdxCount = 0;
+
+    bool _stateCacheEnable = false;
+
+    uint32_t _stateCacheMaxAgeUs = 100000;
+
+    // Frame index of the broadcast state read of the running exchange.
+    uint8 _stateIdx = 0;
+
+    // Last broadcast state read: working counter << 16 | OR of the AL status of all slaves. Written by the cyclic thread.
+    std::atomic<uint32_t> _lineStatus{0};
+
+    // Steady clock time in nanoseconds of _lineStatus, 0 if there is none.
+    std::atomic<int64_t> _lineStatusTimeNs{0};
+
+    // _lineStatus for which _statusTable was read slave by slave, 0xFFFFFFFF if none.
+    std::atomic<uint32_t> _tableLineStatus{0xFFFFFFFF};
+
+    // Indicate a failover is running, it started at _failoverStart.
+    bool _failoverActive = false;
+
+    std::chrono::steady_clock::time_point _failoverStart;
+
+    uint32_t _failoverCycles = 0;
+
+    // Group of the hot-plugged slaves.
+    static const uint8 _HOTPLUG_GROUP = 1;
+
+    uint32_t _hotplugReserve = 0;
+
+    // Indicate the hot-plug group is mapped and exchanged by updateProccess().
+    std::atomic<bool> _hotplugActive{false};
+
+    /*
+    Held by updateProccess() for one cycle. checkTopology() takes it only to copy a new ec_slave[] entry 
+    and to raise ec_slavecount, so the cycle waits at most for a copy and never sees a half written slave.
+    */
+    std::mutex _cycleMutex;
+
+    // Working counter that slaves moved from group 0 to the hot-plug group do not add to the LRW of group 0 anymore.
+    std::atomic<int> _hotplugWkcLoss{0};
+
+    // Indicate the topology of the line is known since configMap().
+    bool _topologyValid = false;
+
+    /*
+    Data of one configuration (port states, PDO mapping and its names) is allocated from one arena. 
+    The next configMap() drops all of it at once by releasing the arena, instead of freeing entry by entry, 
+    and entries of one configuration lie close together in memory.
+    */
+    std::pmr::monotonic_buffer_resource _configArena{64 * 1024};
+
+    /*
+    PDO mappings and their names are taken from a pool on top of the arena. A hot-plugged slave gets its mapping 
+    read again, the pool reuses the memory of its old mapping for it, so replugging does not grow the arena.
+    */
+    std::pmr::unsynchronized_pool_resource _pdoPool{&_configArena};
+
+    // Port state (DL status) of each slave found by configMap(), index is slave number.
+    std::pmr::vector<uint16_t> _portStatus{&_configArena};
+
+    // Process data objects of each slave, index is slave number. Read by the first getPdoMapping() of the slave.
+    std::pmr::vector<std::pmr::vector<EcPdoEntry>> _pdoMapping{&_pdoPool};
+
+    // _pdoMapping of the slave is read, index is slave number.
+    bool _pdoMappingRead[EC_MAXSLAVE] = {};
+
+    // Protect _pdoMapping, _pdoMappingRead and _pdoPool.
+    std::mutex _pdoMutex;
+
+    uint32_t _topologyCheckPeriodMs = 0;
+
+    std::vector<EcTopologyChange> _topologyChanges;
+
+    // Protect _topologyChanges, checkTopology() may run in the error check thread.
+    std::mutex _topologyMutex;
+
+    EthercatMetrics *_metrics = nullptr;
+
+    EthercatTrace *_trace = nullptr;
+
+    EthercatMailbox *_mailbox = nullptr;
+
+    EcStartupTiming _startupTiming;
+
+    std::vector<EcTransitionResult> _transitionResults;
+
+    // First and longest sleep between two state polls of _waitState() in microseconds.
+    static const uint32_t _STATE_POLL_MIN_US = 50;
+    static const uint32_t _STATE_POLL_MAX_US = 10000;
+
+    // Store the time of a startup phase into target when it leaves the scope.
+    struct _PhaseTimer
+    {
+        uint32_t &target;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        ~_PhaseTimer() {target = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();}
+    };
+
     // Refresh states of all slaves state and read them.
     void _readStates(void);
 
+    // State of all slaves, copied from ec_slave[] by _refreshStatusTable().
+    EcStatusTable _statusTable;
+
+    /*
+    Held while _statusTable is read or written, and around the state read into ec_slave[] that fills it. User threads 
+    and the error check thread both refresh the table. The cyclic thread never waits for it, it uses _slaveFailed.
+    */
+    std::mutex _statusMutex;
+
+    // 1 if the slave is lost or not operational, stored together with _statusTable for the cyclic thread.
+    std::atomic<bool> _slaveFailed[EC_MAXSLAVE] = {};
+
+    /*
+    Copy state, AL status code, group, working counter and lost flag of all slaves from ec_slave[] into _statusTable.
+    Caller holds _statusMutex.
+    */
+    void _refreshStatusTable(void);
+
+    // Return true if all slaves in _statusTable are in state. Compares eight slaves at once with SSE2. Caller holds _statusMutex.
+    bool _allInState(uint16 state);
+
+    // Return true and the last broadcast state read in line if the state cache is enabled and the read is not too old.
+    bool _lineStatusValid(uint32_t &line);
+
+    // Return the state of all slaves from a valid broadcast state read if they are all in the same state, else 0.
+    uint16 _uniformState(void);
+
+    // Bring _statusTable up to date, from the broadcast state read if possible, else read all slaves. Caller holds _statusMutex.
+    void _updateStates(void);
+
+    // Send the broadcast state read in its own frame, behind the process data.
+    void _sendStateRead(void);
+
+    // Receive the broadcast state read into _lineStatus. Without wait, the frame is only dropped.
+    void _receiveStateRead(bool wait);
+
+    // Return key for _sdoCache.
+    static uint64_t _sdoCacheKey(uint16 slave_num, uint16 index, uint8 subindex)
+    {
+        return ((uint64_t)slave_num << 24) | ((uint64_t)index << 8) | subindex;
+    }
+
+    // Read SDO, size is updated with the number of bytes received.
+    int _readSDO(uint16 slave_num, uint16 index, uint8 subindex, int *size, void *buffer);
+
+    // Check size against the object dictionary if setSdoTypeCheck() is enabled. Set errorMessage if not valid.
+    bool _checkSdoSize(uint16 slave_num, uint16 index, uint8 subindex, size_t size);
+
+    // Set errorMessage from a function that may run in several threads.
+    void _setError(const std::string &message);
+
+    // Drop all cached SDO values of a slave.
+    void _invalidateSdoCache(uint16 slave_num);
+
+    // Compare outputs with _outputShadow, fill _outputDirtyRanges and update _outputShadow.
+    void _trackOutputChanges(void);
+
+    // Send and receive process data once, return working counter.
+    int _exchange(void);
+
+    // Send and receive process data with one datagram per segment, fill _wkcFaults. 
+    // Return working counter as the LRW would count it, or EC_NOFRAME if a frame was lost.
+    int _exchangeDiagnostic(void);
+
+    // Add the output or input datagrams of all segments to _wkcDatagrams.
+    bool _planWkcDatagrams(bool outputs, uint16_t slaves_per_datagram);
+
+    // Count frames per port of the last exchange and track ring breaks and failover time.
+    void _updateRedundancyStats(bool ok, std::chrono::steady_clock::time_point cycle_start);
+
+    // Apply the policy of a failed or late cycle.
+    void _applyCyclePolicy(EcCyclePolicy policy);
+
+    // Count a failed cycle for the slaves of group 0 that are known to be not operational.
+    void _countSlaveCycleErrors(void);
+
+    // Lock all memory of the process and keep the heap mapped. Set errorMessage if not successed.
+    bool _lockMemory(void);
+
+    // Grow the stack of the calling thread by bytes, so these pages are mapped before the cycle needs them.
+    static void _prefaultStack(uint32_t bytes);
+
+    // Read page fault counters of the calling thread. Return false if not successed.
+    static bool _readPageFaults(uint64_t &minor, uint64_t &major);
+
+    // Count the page faults of the window when it is complete.
+    void _countPageFaults(void);
+
+    // Set _expectedWKC from group 0, and the hot-plug group if it is exchanged.
+    void _updateExpectedWKC(bool hotplug);
+
+    // Read the port state of all slaves into _portStatus.
+    void _captureTopology(void);
+
+    // Read the process data objects of a slave into _pdoMapping.
+    void _readPdoMapping(uint16 slave);
+
+    /**
+     * @brief Add the objects of the PDOs assigned to a sync manager of a CoE slave to _pdoMapping.
+     * @param bit_offset is the bit position of the first object after the start of the process data of the slave.
+     * @return number of bits mapped.
+     */
+    uint32_t _readPdoAssign(uint16 slave, uint8 sm, bool output, uint32_t bit_offset);
+
+    // Add the RxPDO (output true) or TxPDO objects in the SII of a slave to _pdoMapping. Return number of bits mapped.
+    uint32_t _readSiiPdo(uint16 slave, bool output);
+
+    // Add an object to _pdoMapping of the slave, bit_offset counted from the start of its inputs or outputs.
+    void _addPdoEntry(uint16 slave, EcPdoEntry &entry, uint32_t bit_offset);
+
+    // Return a copy of text from _pdoPool.
+    const char* _pdoString(const char *text);
+
+    // Give the names of a mapping back to _pdoPool and clear it.
+    void _clearPdoMapping(uint16 slave);
+
+    // Read the port state of a slave. Return false if the slave does not answer at its address.
+    bool _readPortStatus(uint16 slave, uint16_t &status);
+
+    void _addTopologyChange(uint16 slave, EcTopologyEvent event);
+
+    // Report a recovery action to the attached metrics and trace.
+    void _recoveryAction(uint16 slave, EcRecoveryAction action);
+
+    /**
+     * @brief Read the AL state of the line with one broadcast read. The states of all slaves are ORed together, 
+     * so the line is in a state only if the working counter is the number of slaves and state is this state.
+     * @return working counter of the read.
+     */
+    int _readLineState(uint16 &state);
+
+    /**
+     * @brief Request a state for all slaves and wait for it. Nothing is sent if all slaves are in the state already.
+     * @param exchange sends process data once before the request, slaves check the outputs on the way to OP.
+     * @return true if all slaves reached the state.
+     */
+    bool _requestState(uint16 state, uint32_t timeout_us, bool exchange = false);
+
+    /**
+     * @brief Poll the line state with exponential backoff until all slaves are in the state. 
+     * On timeout the state of each slave is read for error messages.
+     * @return true if all slaves reached the state.
+     */
+    bool _waitState(uint16 state, uint32_t timeout_us);
+
+    // Report the result of a state request for all slaves to the attached metrics and trace.
+    void _stateResult(uint16 state, bool ok);
+
+    // Report start of an SDO transfer to the attached trace. Return start time for _sdoEnd().
+    std::chrono::steady_clock::time_point _sdoBegin(uint16 slave, uint16 index, uint8 subindex, bool write);
+
+    // Report end of an SDO transfer to the attached metrics and trace.
+    void _sdoEnd(uint16 slave, bool write, std::chrono::steady_clock::time_point start, int wkc);
+
+    // Give the unaddressed device at the position of slave its address and bring it to PRE_OP, like ec_config_init() does.
+    bool _configHotplugSlave(uint16 slave);
+
+    // Map all slaves of the hot-plug group into the reserve and bring them to OP.
+    bool _mapHotplugGroup(void);
+
     // thread function for ethercat error handling.
     OSAL_THREAD_FUNC _ecatcheck();
 
     // Attach thread for function ethercat error handling. 
     void _joinThreadErrorCheck(void);
 
-    std::string _slaveStateNum2Str(int slave_num);
+    static const char* _slaveStateNum2Str(int slave_num);
 
 };
 
@@ -1,5 +1,5 @@
 // For complie and build:
-// mkdir -p ./bin && g++ -o ./bin/ex1 ex1.cpp ../SimpleEthercat.cpp -lsoem -Wall -Wextra -std=c++17
+// mkdir -p ./bin && g++ -o ./bin/ex1 ex1.cpp ../SimpleEthercat.cpp ../EthercatODCache.cpp ../EthercatWorkers.cpp ../EthercatMetrics.cpp ../EthercatTrace.cpp ../EthercatMailbox.cpp ../EthercatEmergency.cpp -lsoem -Wall -Wextra -std=c++17
 
 // For run:
 // sudo ./bin/ex1